@@ -1,75 +1,337 @@
+#define _GNU_SOURCE
+
 #include "utf8t_cp1251.h"
 #include "utf8t_iso-8859-5.h"
 #include "utf8t_koi8r.h"
 #include "utf8translator.h"
 #include <errno.h>
+#include <pthread.h>
 #include <stdbool.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
 #include <unistd.h>
 
-void register_encodings();
+#define READ_BUFFER_SIZE (64 * 1024)
+#define WRITE_BUFFER_SIZE (READ_BUFFER_SIZE * MAX_BYTES_IN_UTF8_CODEPOINT)
+#define MAX_THREADS 64
+#define PARALLEL_CHUNK_SIZE (8 * 1024 * 1024)
+
+typedef bool (*block_convert_fn)(utf8t_encoding_id_t encoding_id,
+                                 const uint8_t source[], size_t source_size,
+                                 uint8_t destination[],
+                                 size_t destination_size,
+                                 size_t *consumed_bytes,
+                                 size_t *produced_bytes);
+
+typedef struct {
+  utf8t_encoding_id_t encoding;
+  bool from_utf8;
+  const uint8_t *source;
+  size_t source_size;
+  uint8_t *buffer;
+  size_t buffer_size;
+  size_t produced;
+  // Offset of the character the conversion stopped at
+  size_t error_position;
+  int result;
+} chunk_task;
+
+bool register_encodings();
 void print_usage(const char *app_name);
 void show_avaliable_encodings();
 
-bool encode_file(FILE *infile, FILE *outfile, utf8t_encoding_id_t encoding) {
+bool encode_file(FILE *infile, FILE *outfile, utf8t_encoding_id_t encoding,
+                 block_convert_fn convert_block) {
+  bool ret_val = true;
   size_t current_byte_counter = 0;
-  // size_t bytes_written = 0;
-  uint8_t first_byte_in_char;
+  // Bytes of a character split between two reads, kept at the buffer start
+  size_t pending_size = 0;
+  uint8_t *read_buffer = malloc(READ_BUFFER_SIZE);
+  uint8_t *write_buffer = malloc(WRITE_BUFFER_SIZE);
+  if (read_buffer == NULL || write_buffer == NULL) {
+    perror("Cannot allocate buffers");
+    ret_val = false;
+    goto release_resources;
+  }
   while (1) {
-    size_t readed =
-        fread(&first_byte_in_char, sizeof(first_byte_in_char), 1, infile);
+    size_t readed = fread(read_buffer + pending_size, sizeof(uint8_t),
+                          READ_BUFFER_SIZE - pending_size, infile);
     if (ferror(infile)) {
       perror("Error reading file");
-      return false;
+      ret_val = false;
+      goto release_resources;
     }
     if (readed == 0) {
       break;
     }
-    size_t char_size = utf8t_get_bytes_in_char(encoding, first_byte_in_char);
-    if (char_size == 0) {
-      fprintf(stderr, "Cannot find char size at position %zu",
-              current_byte_counter);
+    size_t data_size = pending_size + readed;
+    size_t position = 0;
+    while (position < data_size) {
+      size_t consumed;
+      size_t produced;
+      bool result = convert_block(encoding, read_buffer + position,
+                                  data_size - position, write_buffer,
+                                  WRITE_BUFFER_SIZE, &consumed, &produced);
+      // Text before the failed character is still written, as in
+      // encode_file_parallel
+      size_t written_bytes =
+          fwrite(write_buffer, sizeof(uint8_t), produced, outfile);
+      if (written_bytes != produced || ferror(outfile)) {
+        perror("Error writing file");
+        ret_val = false;
+        goto release_resources;
+      }
+      if (!result) {
+        fprintf(stderr, "Cannot encode character at position %zu",
+                current_byte_counter + position + consumed);
+        ret_val = false;
+        goto release_resources;
+      }
+      if (consumed == 0) {
+        break;
+      }
+      position += consumed;
+    }
+    current_byte_counter += position;
+    pending_size = data_size - position;
+    memmove(read_buffer, read_buffer + position, pending_size);
+  }
+  if (pending_size > 0) {
+    fprintf(stderr, "Incomplete character at position %zu",
+            current_byte_counter);
+    ret_val = false;
+  }
+release_resources:
+  free(read_buffer);
+  free(write_buffer);
+  return ret_val;
+}
+
+void *convert_chunk(void *arg) {
+  chunk_task *task = arg;
+  task->produced = 0;
+  task->error_position = 0;
+  size_t output_size;
+  if (task->from_utf8 ? !utf8t_get_decoded_size(task->encoding, task->source,
+                                                task->source_size,
+                                                &output_size)
+                      : !utf8t_get_encoded_size(task->encoding, task->source,
+                                                task->source_size,
+                                                &output_size)) {
+    task->result = -1;
+    return NULL;
+  }
+  // Conversion needs room for the largest character beyond the exact size
+  size_t buffer_size = output_size + MAX_BYTES_IN_UTF8_CODEPOINT;
+  if (buffer_size > task->buffer_size) {
+    uint8_t *buffer = realloc(task->buffer, buffer_size);
+    if (buffer == NULL) {
+      task->result = -2;
+      return NULL;
+    }
+    task->buffer = buffer;
+    task->buffer_size = buffer_size;
+  }
+  block_convert_fn convert_block =
+      task->from_utf8 ? utf8t_decode_block : utf8t_encode_block;
+  size_t position = 0;
+  while (position < task->source_size) {
+    size_t consumed;
+    size_t produced;
+    bool result = convert_block(
+        task->encoding, task->source + position, task->source_size - position,
+        task->buffer + task->produced, task->buffer_size - task->produced,
+        &consumed, &produced);
+    task->produced += produced;
+    position += consumed;
+    if (!result || consumed == 0) {
+      task->error_position = position;
+      task->result = result ? -4 : -3;
+      return NULL;
+    }
+  }
+  task->result = 0;
+  return NULL;
+}
+
+/*
+ * Writes the buffers in order with as few system calls as possible: at the
+ * offset with pwritev into regular files, with writev into pipes and
+ * terminals. Partial writes are continued.
+ */
+bool write_buffers(int fd, bool seekable, off_t *offset, struct iovec buffers[],
+                   int count) {
+  while (count > 0) {
+    ssize_t written = seekable ? pwritev(fd, buffers, count, *offset)
+                               : writev(fd, buffers, count);
+    if (written < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
       return false;
     }
-    uint8_t read_buffer[MAX_BYTES_IN_CODEPAGES];
-    read_buffer[0] = first_byte_in_char;
-    size_t more_to_read_in_char = char_size - 1;
-    if (more_to_read_in_char != 0) {
-      readed =
-          fread(read_buffer + 1, sizeof(uint8_t), more_to_read_in_char, infile);
-      if (ferror(infile)) {
-        perror("Error reading file");
-        return false;
+    *offset += written;
+    while (count > 0 && (size_t)written >= buffers->iov_len) {
+      written -= buffers->iov_len;
+      buffers++;
+      count--;
+    }
+    if (count > 0) {
+      buffers->iov_base = (uint8_t *)buffers->iov_base + written;
+      buffers->iov_len -= written;
+    }
+  }
+  return true;
+}
+
+/*
+ * All the codepages are single-byte, so the mapped input can be split at any
+ * character boundary. The input is processed in rounds of thread_count chunks;
+ * each thread sizes its chunk's output, converts it into its own buffer, and
+ * the buffers are written in order.
+ */
+bool encode_file_parallel(int infd, size_t file_size, FILE *outfile,
+                          utf8t_encoding_id_t encoding, bool from_utf8,
+                          size_t thread_count) {
+  if (file_size == 0) {
+    return true;
+  }
+  bool ret_val = true;
+  chunk_task tasks[MAX_THREADS];
+  pthread_t threads[MAX_THREADS];
+  memset(tasks, 0, sizeof(tasks));
+  uint8_t *data = mmap(NULL, file_size, PROT_READ, MAP_PRIVATE, infd, 0);
+  if (data == MAP_FAILED) {
+    perror("Cannot map file");
+    return false;
+  }
+  posix_madvise(data, file_size, POSIX_MADV_SEQUENTIAL);
+  int outfd = fileno(outfile);
+  struct stat outfile_stat;
+  bool seekable = fflush(outfile) == 0 && fstat(outfd, &outfile_stat) == 0 &&
+                  S_ISREG(outfile_stat.st_mode);
+  off_t offset = seekable ? lseek(outfd, 0, SEEK_CUR) : 0;
+  if (offset < 0) {
+    seekable = false;
+    offset = 0;
+  }
+  size_t position = 0;
+  while (position < file_size) {
+    size_t task_count = 0;
+    size_t chunk_offsets[MAX_THREADS];
+    for (; task_count < thread_count && position < file_size; task_count++) {
+      size_t end = file_size - position > PARALLEL_CHUNK_SIZE
+                       ? position + PARALLEL_CHUNK_SIZE
+                       : file_size;
+      // UTF-8 sequences are not split between chunks
+      size_t sequence_start = end;
+      while (from_utf8 && sequence_start < file_size &&
+             sequence_start > position && end - sequence_start < 3 &&
+             (data[sequence_start] & 0xC0) == 0x80) {
+        sequence_start--;
       }
-      if (readed == 0) {
+      if (sequence_start > position) {
+        end = sequence_start;
+      }
+      chunk_task *task = &tasks[task_count];
+      task->encoding = encoding;
+      task->from_utf8 = from_utf8;
+      task->source = data + position;
+      task->source_size = end - position;
+      chunk_offsets[task_count] = position;
+      position = end;
+    }
+    size_t started_threads = 0;
+    for (size_t i = 1; i < task_count; i++) {
+      if (pthread_create(&threads[started_threads], NULL, convert_chunk,
+                         &tasks[i]) != 0) {
         break;
       }
+      started_threads++;
     }
-    uint8_t write_buffer[MAX_BYTES_IN_UTF8_CODEPOINT];
-    size_t result_codepoint_size;
-    bool result = utf8t_encode(encoding, read_buffer, char_size, write_buffer,
-                               &result_codepoint_size);
-    if (!result) {
-      fprintf(stderr, "Cannot encode character at position %zu with size %zu",
-              current_byte_counter, char_size);
-      return false;
+    // Chunks no thread was started for are converted by the calling thread
+    for (size_t i = started_threads + 1; i < task_count; i++) {
+      convert_chunk(&tasks[i]);
+    }
+    convert_chunk(&tasks[0]);
+    for (size_t i = 0; i < started_threads; i++) {
+      pthread_join(threads[i], NULL);
     }
-    size_t written_bytes =
-        fwrite(write_buffer, sizeof(uint8_t), result_codepoint_size, outfile);
-    if (written_bytes != result_codepoint_size || ferror(outfile)) {
+    struct iovec buffers[MAX_THREADS];
+    for (size_t i = 0; i < task_count; i++) {
+      chunk_task *task = &tasks[i];
+      buffers[i].iov_base = task->buffer;
+      buffers[i].iov_len = task->produced;
+      if (task->result == 0) {
+        continue;
+      }
+      if (task->result == -2) {
+        perror("Cannot allocate buffers");
+      } else if (task->result == -4) {
+        fprintf(stderr, "Incomplete character at position %zu",
+                chunk_offsets[i] + task->error_position);
+      } else {
+        fprintf(stderr, "Cannot encode character at position %zu",
+                chunk_offsets[i] + task->error_position);
+      }
+      // Text before the failed character is still written
+      task_count = i + 1;
+      ret_val = false;
+      break;
+    }
+    if (!write_buffers(outfd, seekable, &offset, buffers, (int)task_count)) {
       perror("Error writing file");
-      return false;
+      ret_val = false;
+    }
+    if (!ret_val) {
+      break;
     }
-    current_byte_counter += char_size;
-    // bytes_written += result_codepoint_size;
   }
-  return true;
+  if (seekable) {
+    lseek(outfd, offset, SEEK_SET);
+  }
+  for (size_t i = 0; i < thread_count; i++) {
+    free(tasks[i].buffer);
+  }
+  munmap(data, file_size);
+  return ret_val;
 }
 
 int main(int argc, char **argv) {
-  register_encodings();
+  if (!register_encodings()) {
+    fprintf(stderr, "Cannot register encodings\n");
+    utf8t_close();
+    return 5;
+  }
   int ret_val = 0;
+  char *app_name = argv[0];
+  bool from_utf8 = false;
+  size_t thread_count = 1;
+  // Options go before the encoding, the rest of arguments are the same
+  while (argc > 1) {
+    if (strcmp(argv[1], "-r") == 0) {
+      from_utf8 = true;
+      argv++;
+      argc--;
+    } else if (strcmp(argv[1], "-j") == 0 && argc > 2) {
+      thread_count = strtoul(argv[2], NULL, 10);
+      if (thread_count == 0) {
+        long cpu_count = sysconf(_SC_NPROCESSORS_ONLN);
+        thread_count = cpu_count > 0 ? (size_t)cpu_count : 1;
+      }
+      if (thread_count > MAX_THREADS) {
+        thread_count = MAX_THREADS;
+      }
+      argv += 2;
+      argc -= 2;
+    } else {
+      break;
+    }
+  }
   char *infile_name = argc < 3 ? NULL : argv[2];
   bool in_file_is_stdin = argc < 3 || strcmp(argv[2], "-") == 0;
   FILE *infile = NULL;
@@ -77,13 +339,13 @@ int main(int argc, char **argv) {
   bool out_file_is_stdout = argc < 4 || strcmp(argv[3], "-") == 0;
   FILE *outfile = NULL;
   if (argc > 1 && strcmp(argv[1], "-h") == 0) {
-    print_usage(argv[0]);
+    print_usage(app_name);
     goto release_resources;
   }
 
   if (argc < 2) {
     fprintf(stderr, "Encoding must be specified!");
-    print_usage(argv[0]);
+    print_usage(app_name);
     ret_val = 1;
     goto release_resources;
   }
@@ -125,7 +387,20 @@ int main(int argc, char **argv) {
     goto release_resources;
   }
 
-  bool endcode_result = encode_file(infile, outfile, selected_encoding_id);
+  bool endcode_result;
+  struct stat infile_stat;
+  if (thread_count > 1 && !in_file_is_stdin &&
+      utf8t_is_single_byte(selected_encoding_id) &&
+      fstat(fileno(infile), &infile_stat) == 0 &&
+      S_ISREG(infile_stat.st_mode)) {
+    endcode_result = encode_file_parallel(
+        fileno(infile), infile_stat.st_size, outfile, selected_encoding_id,
+        from_utf8, thread_count);
+  } else {
+    endcode_result =
+        encode_file(infile, outfile, selected_encoding_id,
+                    from_utf8 ? utf8t_decode_block : utf8t_encode_block);
+  }
   if (!endcode_result) {
     ret_val = 4;
     goto release_resources;
@@ -141,10 +416,10 @@ release_resources:
   return ret_val;
 }
 
-void register_encodings() {
-  utf8t_register_encoding(utf8t_encoding_get_cp1251());
-  utf8t_register_encoding(utf8t_encoding_get_koi8r());
-  utf8t_register_encoding(utf8t_encoding_get_iso8859_5());
+bool register_encodings() {
+  return utf8t_register_encoding(utf8t_encoding_get_cp1251()) &&
+         utf8t_register_encoding(utf8t_encoding_get_koi8r()) &&
+         utf8t_register_encoding(utf8t_encoding_get_iso8859_5());
 }
 
 void show_avaliable_encodings() {
@@ -162,6 +437,9 @@ void show_avaliable_encodings() {
 }
 
 void print_usage(const char *app_name) {
-  printf("Usage: %s <from_encoding> [in_file] [out_file]\n", app_name);
+  printf("Usage: %s [-r] [-j threads] <from_encoding> [in_file] [out_file]\n",
+         app_name);
+  printf("  -r  convert from utf-8 to the encoding\n");
+  printf("  -j N  convert in_file in N threads, 0 - one thread per CPU\n");
   show_avaliable_encodings();
 }
@@ -0,0 +1,195 @@
+#include "utf8t_cp1251.h"
+#include "utf8t_iso-8859-5.h"
+#include "utf8t_koi8r.h"
+#include "utf8translator.h"
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// The text repeats every translatable byte, long enough for the vector paths
+#define TEXT_REPEATS 300
+#define SMALL_BLOCK_SIZE 7
+
+#define CHECK(condition)                                                       \
+  do {                                                                         \
+    if (!(condition)) {                                                        \
+      fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__,         \
+              #condition);                                                     \
+      return false;                                                            \
+    }                                                                          \
+  } while (0)
+
+static char *const encoding_codes[] = {"cp1251", "koi8-r", "iso-8859-5"};
+
+/*
+ * Every byte of the encoding whose character converts back to it, TEXT_REPEATS
+ * times. Bytes without a character of their own (cp1251 0x98 is translated to
+ * a space) are left out.
+ */
+static size_t make_text(utf8t_encoding_id_t encoding, uint8_t *text) {
+  uint8_t translatable[256];
+  size_t count = 0;
+  for (size_t byte = 0; byte < 256; byte++) {
+    uint8_t source = (uint8_t)byte;
+    uint8_t buffer[MAX_BYTES_IN_UTF8_CODEPOINT * 2];
+    uint8_t back[MAX_BYTES_IN_CODEPAGES * 2];
+    size_t consumed;
+    size_t produced;
+    size_t back_size;
+    if (utf8t_encode_block(encoding, &source, 1, buffer, sizeof(buffer),
+                           &consumed, &produced) &&
+        consumed == 1 &&
+        utf8t_decode_block(encoding, buffer, produced, back, sizeof(back),
+                           &consumed, &back_size) &&
+        back_size == 1 && back[0] == source) {
+      translatable[count++] = source;
+    }
+  }
+  for (size_t i = 0; i < TEXT_REPEATS; i++) {
+    memcpy(text + i * count, translatable, count);
+  }
+  return count * TEXT_REPEATS;
+}
+
+static bool test_round_trip(utf8t_encoding_id_t encoding, const uint8_t *text,
+                            size_t text_size) {
+  size_t utf8_capacity = text_size * MAX_BYTES_IN_UTF8_CODEPOINT;
+  uint8_t *utf8 = malloc(utf8_capacity);
+  uint8_t *back = malloc(text_size + MAX_BYTES_IN_CODEPAGES);
+  CHECK(utf8 != NULL && back != NULL);
+  size_t consumed;
+  size_t utf8_size;
+  size_t expected_size;
+  bool ok = utf8t_encode_block(encoding, text, text_size, utf8, utf8_capacity,
+                               &consumed, &utf8_size) &&
+            consumed == text_size &&
+            utf8t_get_encoded_size(encoding, text, text_size,
+                                   &expected_size) &&
+            expected_size == utf8_size;
+  size_t back_size = 0;
+  ok = ok &&
+       utf8t_decode_block(encoding, utf8, utf8_size, back,
+                          text_size + MAX_BYTES_IN_CODEPAGES, &consumed,
+                          &back_size) &&
+       consumed == utf8_size && back_size == text_size &&
+       memcmp(back, text, text_size) == 0 &&
+       utf8t_get_decoded_size(encoding, utf8, utf8_size, &expected_size) &&
+       expected_size == text_size;
+  free(utf8);
+  free(back);
+  CHECK(ok);
+  return true;
+}
+
+/*
+ * Converts through destinations of SMALL_BLOCK_SIZE bytes and back from
+ * sources of SMALL_BLOCK_SIZE bytes, so every call stops at a block boundary
+ * and characters split between sources are carried over.
+ */
+static bool test_small_blocks(utf8t_encoding_id_t encoding,
+                              const uint8_t *text, size_t text_size) {
+  uint8_t *utf8 = malloc(text_size * MAX_BYTES_IN_UTF8_CODEPOINT);
+  uint8_t *back = malloc(text_size + SMALL_BLOCK_SIZE);
+  CHECK(utf8 != NULL && back != NULL);
+  bool ok = true;
+  size_t position = 0;
+  size_t utf8_size = 0;
+  while (ok && position < text_size) {
+    size_t consumed;
+    size_t produced;
+    ok = utf8t_encode_block(encoding, text + position, text_size - position,
+                            utf8 + utf8_size, SMALL_BLOCK_SIZE, &consumed,
+                            &produced) &&
+         consumed > 0;
+    position += consumed;
+    utf8_size += produced;
+  }
+  position = 0;
+  size_t back_size = 0;
+  while (ok && position < utf8_size) {
+    size_t source_size = utf8_size - position < SMALL_BLOCK_SIZE
+                             ? utf8_size - position
+                             : SMALL_BLOCK_SIZE;
+    size_t consumed;
+    size_t produced;
+    ok = utf8t_decode_block(encoding, utf8 + position, source_size,
+                            back + back_size, SMALL_BLOCK_SIZE, &consumed,
+                            &produced) &&
+         consumed > 0;
+    position += consumed;
+    back_size += produced;
+  }
+  ok = ok && back_size == text_size && memcmp(back, text, text_size) == 0;
+  free(utf8);
+  free(back);
+  CHECK(ok);
+  return true;
+}
+
+static bool test_known_text(void) {
+  // "Привет" in cp1251 and in UTF-8
+  static const uint8_t cp1251[] = {0xCF, 0xF0, 0xE8, 0xE2, 0xE5, 0xF2};
+  static const char utf8[] = "\xD0\x9F\xD1\x80\xD0\xB8\xD0\xB2\xD0\xB5\xD1\x82";
+  utf8t_encoding_id_t encoding;
+  CHECK(utf8t_get_encoding_by_code("cp1251", &encoding));
+  uint8_t buffer[64];
+  size_t consumed;
+  size_t produced;
+  CHECK(utf8t_encode_block(encoding, cp1251, sizeof(cp1251), buffer,
+                           sizeof(buffer), &consumed, &produced));
+  CHECK(consumed == sizeof(cp1251) && produced == strlen(utf8) &&
+        memcmp(buffer, utf8, produced) == 0);
+  return true;
+}
+
+static bool test_malformed_utf8(void) {
+  // Overlong NUL, a surrogate and a stray continuation byte
+  static const char *const malformed[] = {"a\xC0\x80", "a\xED\xA0\x80",
+                                          "a\x80"};
+  utf8t_encoding_id_t encoding;
+  CHECK(utf8t_get_encoding_by_code("koi8-r", &encoding));
+  for (size_t i = 0; i < sizeof(malformed) / sizeof(malformed[0]); i++) {
+    uint8_t buffer[64];
+    size_t consumed;
+    size_t produced;
+    CHECK(!utf8t_decode_block(encoding, (const uint8_t *)malformed[i],
+                              strlen(malformed[i]), buffer, sizeof(buffer),
+                              &consumed, &produced));
+    CHECK(consumed == 1);
+  }
+  return true;
+}
+
+int main() {
+  if (!utf8t_register_encoding(utf8t_encoding_get_cp1251()) ||
+      !utf8t_register_encoding(utf8t_encoding_get_koi8r()) ||
+      !utf8t_register_encoding(utf8t_encoding_get_iso8859_5())) {
+    fprintf(stderr, "Cannot register encodings\n");
+    return 1;
+  }
+  size_t failed = 0;
+  uint8_t *text = malloc(256 * TEXT_REPEATS);
+  if (text == NULL) {
+    utf8t_close();
+    return 1;
+  }
+  for (size_t i = 0; i < sizeof(encoding_codes) / sizeof(encoding_codes[0]);
+       i++) {
+    utf8t_encoding_id_t encoding;
+    bool ok = utf8t_get_encoding_by_code(encoding_codes[i], &encoding);
+    if (ok) {
+      size_t text_size = make_text(encoding, text);
+      ok = text_size > 0 && test_round_trip(encoding, text, text_size) &&
+           test_small_blocks(encoding, text, text_size);
+    }
+    printf("%s round trip: %s\n", encoding_codes[i], ok ? "ok" : "FAILED");
+    failed += ok ? 0 : 1;
+  }
+  bool ok = test_known_text() && test_malformed_utf8();
+  printf("known and malformed text: %s\n", ok ? "ok" : "FAILED");
+  failed += ok ? 0 : 1;
+  free(text);
+  utf8t_close();
+  return failed > 0 ? 1 : 0;
+}
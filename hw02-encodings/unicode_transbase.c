@@ -1,4 +1,7 @@
 #include "unicode_transbase.h"
+#include <string.h>
+
+#define ONEBYTE_TABLE_SIZE 0x80
 
 bool utf8t_translate_by_onebyte_table(uint8_t source_character,
                                       uint16_t *result,
@@ -11,3 +14,42 @@ bool utf8t_translate_by_onebyte_table(uint8_t source_character,
   *result = translate_table[index];
   return true;
 }
+
+bool utf8t_build_inverse_onebyte_table(
+    const uint16_t translate_table[],
+    utf8t_inverse_onebyte_table *inverse_table) {
+  memset(inverse_table, 0, sizeof(utf8t_inverse_onebyte_table));
+  size_t page_count = 1;
+  for (size_t i = 0; i < ONEBYTE_TABLE_SIZE; i++) {
+    uint16_t unicode_codepoint = translate_table[i];
+    // ASCII codepoints are always written as themselves
+    if (unicode_codepoint < 0x80) {
+      continue;
+    }
+    uint8_t high_byte = unicode_codepoint >> 8;
+    if (inverse_table->page_by_high_byte[high_byte] == 0) {
+      if (page_count == UTF8T_MAX_INVERSE_PAGES) {
+        return false;
+      }
+      inverse_table->page_by_high_byte[high_byte] = page_count++;
+    }
+    uint8_t *page =
+        inverse_table->pages[inverse_table->page_by_high_byte[high_byte]];
+    if (page[unicode_codepoint & 0xFF] == 0) {
+      page[unicode_codepoint & 0xFF] = (uint8_t)(0x80 + i);
+    }
+  }
+  return true;
+}
+
+bool utf8t_translate_by_inverse_onebyte_table(
+    uint16_t unicode_codepoint, uint8_t *result,
+    const utf8t_inverse_onebyte_table *inverse_table) {
+  if (unicode_codepoint < 0x80) {
+    *result = (uint8_t)unicode_codepoint;
+    return true;
+  }
+  uint8_t page = inverse_table->page_by_high_byte[unicode_codepoint >> 8];
+  *result = inverse_table->pages[page][unicode_codepoint & 0xFF];
+  return *result != 0;
+}
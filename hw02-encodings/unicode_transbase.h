@@ -8,4 +8,25 @@ bool utf8t_translate_by_onebyte_table(uint8_t source_character,
                                       uint16_t *result,
                                       const uint16_t translate_table[]);
 
+#define UTF8T_MAX_INVERSE_PAGES 16
+#define UTF8T_INVERSE_PAGE_SIZE 256
+
+/*
+ * Inverse of a one-byte table as a two-level page table over the BMP: the
+ * high byte of a codepoint selects a page, the low byte selects a character
+ * in it. Page 0 is empty and shared by all unmapped ranges, so only the few
+ * pages a codepage actually uses take memory.
+ */
+typedef struct {
+  uint8_t page_by_high_byte[UTF8T_INVERSE_PAGE_SIZE];
+  uint8_t pages[UTF8T_MAX_INVERSE_PAGES][UTF8T_INVERSE_PAGE_SIZE];
+} utf8t_inverse_onebyte_table;
+
+bool utf8t_build_inverse_onebyte_table(
+    const uint16_t translate_table[],
+    utf8t_inverse_onebyte_table *inverse_table);
+bool utf8t_translate_by_inverse_onebyte_table(
+    uint16_t unicode_codepoint, uint8_t *result,
+    const utf8t_inverse_onebyte_table *inverse_table);
+
 #endif
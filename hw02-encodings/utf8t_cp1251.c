@@ -35,15 +35,28 @@ translate_cp1251_char_to_unicode_codepoint(uint8_t *source_codepoint,
       cp1251_unicode_codepoint_by_char_position);
 }
 
+static utf8t_inverse_onebyte_table cp1251_inverse_table;
+
+static bool
+translate_unicode_codepoint_to_cp1251_char(uint16_t codepoint,
+                                           uint8_t result_char[],
+                                           size_t *result_char_size) {
+  *result_char_size = 1;
+  return utf8t_translate_by_inverse_onebyte_table(codepoint, result_char,
+                                                  &cp1251_inverse_table);
+}
+
 static encoding_entry_t cp1251_encoding = {
     .id = UTF8T_CP1251_ENCODING_ID,
     .code = "cp1251",
     .get_codepoint_size_func = get_cp1251_char_size,
-    .translate_func = translate_cp1251_char_to_unicode_codepoint};
+    .translate_func = translate_cp1251_char_to_unicode_codepoint,
+    .translate_codepoint_func = translate_unicode_codepoint_to_cp1251_char};
 
 static bool register_cp1251(encoding_entry_t *encoding_registry[]) {
   encoding_registry[UTF8T_CP1251_ENCODING_ID] = &cp1251_encoding;
-  return true;
+  return utf8t_build_inverse_onebyte_table(
+      cp1251_unicode_codepoint_by_char_position, &cp1251_inverse_table);
 }
 
 static utf8t_encoding_descriptor_t UTF8T_CP1251_DESCRIPTOR = {
@@ -36,15 +36,28 @@ translate_iso8859_5_char_to_unicode_codepoint(uint8_t *source_codepoint,
       iso8859_5_unicode_codepoint_by_char_position);
 }
 
+static utf8t_inverse_onebyte_table iso8859_5_inverse_table;
+
+static bool
+translate_unicode_codepoint_to_iso8859_5_char(uint16_t codepoint,
+                                              uint8_t result_char[],
+                                              size_t *result_char_size) {
+  *result_char_size = 1;
+  return utf8t_translate_by_inverse_onebyte_table(codepoint, result_char,
+                                                  &iso8859_5_inverse_table);
+}
+
 static encoding_entry_t iso8859_5_encoding = {
     .id = UTF8T_ISO_8859_5_ENCODING_ID,
     .code = "iso-8859-5",
     .get_codepoint_size_func = get_iso8859_5_char_size,
-    .translate_func = translate_iso8859_5_char_to_unicode_codepoint};
+    .translate_func = translate_iso8859_5_char_to_unicode_codepoint,
+    .translate_codepoint_func = translate_unicode_codepoint_to_iso8859_5_char};
 
 static bool register_iso8859_5(encoding_entry_t *encoding_registry[]) {
   encoding_registry[UTF8T_ISO_8859_5_ENCODING_ID] = &iso8859_5_encoding;
-  return true;
+  return utf8t_build_inverse_onebyte_table(
+      iso8859_5_unicode_codepoint_by_char_position, &iso8859_5_inverse_table);
 }
 
 static utf8t_encoding_descriptor_t UTF8T_ISO_8859_5_DESCRIPTOR = {
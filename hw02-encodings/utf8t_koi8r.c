@@ -35,15 +35,28 @@ translate_koi8r_char_to_unicode_codepoint(uint8_t *source_codepoint,
       koi8r_unicode_codepoint_by_char_position);
 }
 
+static utf8t_inverse_onebyte_table koi8r_inverse_table;
+
+static bool
+translate_unicode_codepoint_to_koi8r_char(uint16_t codepoint,
+                                          uint8_t result_char[],
+                                          size_t *result_char_size) {
+  *result_char_size = 1;
+  return utf8t_translate_by_inverse_onebyte_table(codepoint, result_char,
+                                                  &koi8r_inverse_table);
+}
+
 static encoding_entry_t koi8r_encoding = {
     .id = UTF8T_KOI8R_ENCODING_ID,
     .code = "koi8-r",
     .get_codepoint_size_func = get_koi8r_char_size,
-    .translate_func = translate_koi8r_char_to_unicode_codepoint};
+    .translate_func = translate_koi8r_char_to_unicode_codepoint,
+    .translate_codepoint_func = translate_unicode_codepoint_to_koi8r_char};
 
 static bool register_koi8r(encoding_entry_t *encoding_registry[]) {
   encoding_registry[UTF8T_KOI8R_ENCODING_ID] = &koi8r_encoding;
-  return true;
+  return utf8t_build_inverse_onebyte_table(
+      koi8r_unicode_codepoint_by_char_position, &koi8r_inverse_table);
 }
 
 static utf8t_encoding_descriptor_t UTF8T_KOI8R_DESCRIPTOR = {
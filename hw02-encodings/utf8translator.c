@@ -4,17 +4,108 @@
 #include <stdlib.h>
 #include <string.h>
 
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
 #define REGISTRY_SIZE UINT8_MAX
 
+#define BYTE_VALUES_COUNT 256
+#define MAX_UNICODE_CODEPOINT 0x10FFFF
+// decode_utf8 result for a sequence cut off by the end of the source
+#define UTF8_INCOMPLETE SIZE_MAX
+
+/*
+ * UTF-8 bytes of a character, padded so that the whole entry can be copied
+ * with a single 4-byte store; only the first length bytes are meaningful.
+ */
+typedef struct {
+  uint8_t bytes[MAX_BYTES_IN_UTF8_CODEPOINT - 1];
+  uint8_t length;
+} utf8_sequence_t;
+
+typedef struct {
+  utf8_sequence_t sequences[BYTE_VALUES_COUNT];
+  // Bytes below 0x80 are ASCII and can be copied as is
+  bool ascii_compatible;
+} utf8_table_t;
+
 static encoding_entry_t *encodings_registry[REGISTRY_SIZE];
+// Direct byte -> UTF-8 tables of registered single-byte encodings
+static utf8_table_t *utf8_tables[REGISTRY_SIZE];
 
-void utf8t_register_encoding(utf8t_encoding_descriptor_t *descriptor) {
-  descriptor->register_encoding_function(encodings_registry);
+static bool
+translate_unicode_to_utf8(uint16_t unicode_codepoint,
+                          uint8_t buffer[MAX_BYTES_IN_UTF8_CODEPOINT],
+                          size_t *result_bytes_size) {
+  if (unicode_codepoint <= 0x7F) {
+    buffer[0] = (uint8_t)unicode_codepoint;
+    *result_bytes_size = 1;
+  } else if (unicode_codepoint <= 0x07FF) {
+    buffer[0] = (uint8_t)(((unicode_codepoint >> 6) & 0x1F) | 0xC0);
+    buffer[1] = (uint8_t)(((unicode_codepoint >> 0) & 0x3F) | 0x80);
+    *result_bytes_size = 2;
+  } else {
+    buffer[0] = (uint8_t)(((unicode_codepoint >> 12) & 0x0F) | 0xE0);
+    buffer[1] = (uint8_t)(((unicode_codepoint >> 6) & 0x3F) | 0x80);
+    buffer[2] = (uint8_t)(((unicode_codepoint >> 0) & 0x3F) | 0x80);
+    *result_bytes_size = 3;
+  };
+  return true;
+}
+
+static utf8_table_t *build_utf8_table(encoding_entry_t *pencoding) {
+  for (size_t i = 0; i < BYTE_VALUES_COUNT; i++) {
+    if (pencoding->get_codepoint_size_func((uint8_t)i) != 1) {
+      return NULL;
+    }
+  }
+  utf8_table_t *table = calloc(1, sizeof(utf8_table_t));
+  if (table == NULL) {
+    return NULL;
+  }
+  table->ascii_compatible = true;
+  for (size_t i = 0; i < BYTE_VALUES_COUNT; i++) {
+    uint8_t source_char = (uint8_t)i;
+    uint16_t unicode_codepoint = 0;
+    uint8_t buffer[MAX_BYTES_IN_UTF8_CODEPOINT];
+    size_t codepoint_size = 0;
+    if (!pencoding->translate_func(&source_char, 1, &unicode_codepoint) ||
+        !translate_unicode_to_utf8(unicode_codepoint, buffer,
+                                   &codepoint_size) ||
+        codepoint_size > sizeof(table->sequences[i].bytes)) {
+      free(table);
+      return NULL;
+    }
+    memcpy(table->sequences[i].bytes, buffer, codepoint_size);
+    table->sequences[i].length = (uint8_t)codepoint_size;
+    if (i < 0x80 && (codepoint_size != 1 || buffer[0] != i)) {
+      table->ascii_compatible = false;
+    }
+  }
+  return table;
+}
+
+bool utf8t_register_encoding(utf8t_encoding_descriptor_t *descriptor) {
+  if (!descriptor->register_encoding_function(encodings_registry)) {
+    return false;
+  }
+  // Encodings without a table are converted character by character
+  for (size_t i = 0; i < REGISTRY_SIZE; i++) {
+    if (encodings_registry[i] != NULL && utf8_tables[i] == NULL) {
+      utf8_tables[i] = build_utf8_table(encodings_registry[i]);
+    }
+  }
+  return true;
 }
 
 void utf8t_close() {
   for (size_t i = 0; i < REGISTRY_SIZE; i++) {
     encodings_registry[i] = NULL;
+    free(utf8_tables[i]);
+    utf8_tables[i] = NULL;
   }
 }
 
@@ -66,26 +157,6 @@ size_t utf8t_get_bytes_in_char(utf8t_encoding_id_t encoding_id,
   return pencoding->get_codepoint_size_func(start_byte);
 }
 
-static bool
-translate_unicode_to_utf8(uint16_t unicode_codepoint,
-                          uint8_t buffer[MAX_BYTES_IN_UTF8_CODEPOINT],
-                          size_t *result_bytes_size) {
-  if (unicode_codepoint <= 0x7F) {
-    buffer[0] = (uint8_t)unicode_codepoint;
-    *result_bytes_size = 1;
-  } else if (unicode_codepoint <= 0x07FF) {
-    buffer[0] = (uint8_t)(((unicode_codepoint >> 6) & 0x1F) | 0xC0);
-    buffer[1] = (uint8_t)(((unicode_codepoint >> 0) & 0x3F) | 0x80);
-    *result_bytes_size = 2;
-  } else {
-    buffer[0] = (uint8_t)(((unicode_codepoint >> 12) & 0x0F) | 0xE0);
-    buffer[1] = (uint8_t)(((unicode_codepoint >> 6) & 0x3F) | 0x80);
-    buffer[2] = (uint8_t)(((unicode_codepoint >> 0) & 0x3F) | 0x80);
-    *result_bytes_size = 3;
-  };
-  return true;
-}
-
 bool utf8t_encode(utf8t_encoding_id_t encoding_id, uint8_t source_char[],
                   size_t source_char_size_bytes,
                   uint8_t buffer[MAX_BYTES_IN_UTF8_CODEPOINT],
@@ -101,3 +172,253 @@ bool utf8t_encode(utf8t_encoding_id_t encoding_id, uint8_t source_char[],
   return translate_unicode_to_utf8(unicode_codepoint_result, buffer,
                                    result_bytes_size);
 }
+
+#if defined(__AVX2__)
+#define VECTOR_SIZE 32
+typedef __m256i vector_t;
+
+static inline uint32_t copy_vector(const uint8_t *source, uint8_t *destination) {
+  vector_t chunk = _mm256_loadu_si256((const vector_t *)source);
+  _mm256_storeu_si256((vector_t *)destination, chunk);
+  return (uint32_t)_mm256_movemask_epi8(chunk);
+}
+#elif defined(__SSE2__)
+#define VECTOR_SIZE 16
+typedef __m128i vector_t;
+
+static inline uint32_t copy_vector(const uint8_t *source, uint8_t *destination) {
+  vector_t chunk = _mm_loadu_si128((const vector_t *)source);
+  _mm_storeu_si128((vector_t *)destination, chunk);
+  return (uint32_t)_mm_movemask_epi8(chunk);
+}
+#endif
+
+/*
+ * Copies the run of ASCII bytes at the start of the source and returns its
+ * length. Whole vectors are stored even if they end with non-ASCII bytes, so
+ * the destination must have room for size bytes.
+ */
+static size_t copy_ascii(const uint8_t source[], size_t size,
+                         uint8_t destination[]) {
+  size_t position = 0;
+#ifdef VECTOR_SIZE
+  while (position + VECTOR_SIZE <= size) {
+    uint32_t high_bits = copy_vector(source + position, destination + position);
+    if (high_bits != 0) {
+      return position + __builtin_ctz(high_bits);
+    }
+    position += VECTOR_SIZE;
+  }
+#endif
+  while (position < size && source[position] < 0x80) {
+    destination[position] = source[position];
+    position++;
+  }
+  return position;
+}
+
+bool utf8t_is_single_byte(utf8t_encoding_id_t encoding_id) {
+  return utf8_tables[encoding_id] != NULL;
+}
+
+bool utf8t_get_encoded_size(utf8t_encoding_id_t encoding_id,
+                            const uint8_t source[], size_t source_size,
+                            size_t *encoded_size) {
+  const utf8_table_t *table = utf8_tables[encoding_id];
+  if (table == NULL) {
+    return false;
+  }
+  size_t size = 0;
+  for (size_t i = 0; i < source_size; i++) {
+    size += table->sequences[source[i]].length;
+  }
+  *encoded_size = size;
+  return true;
+}
+
+bool utf8t_get_decoded_size(utf8t_encoding_id_t encoding_id,
+                            const uint8_t source[], size_t source_size,
+                            size_t *decoded_size) {
+  if (utf8_tables[encoding_id] == NULL) {
+    return false;
+  }
+  // Every byte except continuation bytes starts a one-byte character
+  size_t size = 0;
+  for (size_t i = 0; i < source_size; i++) {
+    size += (source[i] & 0xC0) != 0x80;
+  }
+  *decoded_size = size;
+  return true;
+}
+
+static void encode_block_by_table(const utf8_table_t *table,
+                                  const uint8_t source[], size_t source_size,
+                                  uint8_t destination[],
+                                  size_t destination_size,
+                                  size_t *consumed_bytes,
+                                  size_t *produced_bytes) {
+  size_t consumed = 0;
+  size_t produced = 0;
+  while (consumed < source_size &&
+         destination_size - produced >= MAX_BYTES_IN_UTF8_CODEPOINT) {
+    // Entries are stored as whole 4-byte words, this many fit without checks
+    size_t count = (destination_size - produced) / MAX_BYTES_IN_UTF8_CODEPOINT;
+    if (count > source_size - consumed) {
+      count = source_size - consumed;
+    }
+    const uint8_t *chunk = source + consumed;
+    size_t i = 0;
+    while (i < count) {
+      if (table->ascii_compatible) {
+        size_t ascii_size =
+            copy_ascii(chunk + i, count - i, destination + produced);
+        i += ascii_size;
+        produced += ascii_size;
+        if (i == count) {
+          break;
+        }
+      }
+      // Lone ASCII bytes between non-ASCII ones are cheaper to take from here
+      do {
+        const utf8_sequence_t *sequence = &table->sequences[chunk[i]];
+        memcpy(destination + produced, sequence, sizeof(utf8_sequence_t));
+        produced += sequence->length;
+        i++;
+      } while (i < count && (chunk[i] >= 0x80 ||
+                             (i + 1 < count && chunk[i + 1] >= 0x80)));
+    }
+    consumed += count;
+  }
+  *consumed_bytes = consumed;
+  *produced_bytes = produced;
+}
+
+bool utf8t_encode_block(utf8t_encoding_id_t encoding_id, const uint8_t source[],
+                        size_t source_size, uint8_t destination[],
+                        size_t destination_size, size_t *consumed_bytes,
+                        size_t *produced_bytes) {
+  if (utf8_tables[encoding_id] != NULL) {
+    encode_block_by_table(utf8_tables[encoding_id], source, source_size,
+                          destination, destination_size, consumed_bytes,
+                          produced_bytes);
+    return true;
+  }
+  encoding_entry_t *pencoding = encodings_registry[encoding_id];
+  size_t consumed = 0;
+  size_t produced = 0;
+  bool result = pencoding != NULL;
+  while (result && consumed < source_size &&
+         destination_size - produced >= MAX_BYTES_IN_UTF8_CODEPOINT) {
+    size_t char_size = pencoding->get_codepoint_size_func(source[consumed]);
+    if (char_size == 0 || char_size > MAX_BYTES_IN_CODEPAGES) {
+      result = false;
+      break;
+    }
+    if (char_size > source_size - consumed) {
+      break;
+    }
+    uint16_t unicode_codepoint = 0;
+    size_t codepoint_size = 0;
+    result = pencoding->translate_func((uint8_t *)source + consumed, char_size,
+                                       &unicode_codepoint) &&
+             translate_unicode_to_utf8(unicode_codepoint,
+                                       destination + produced,
+                                       &codepoint_size);
+    if (result) {
+      consumed += char_size;
+      produced += codepoint_size;
+    }
+  }
+  *consumed_bytes = consumed;
+  *produced_bytes = produced;
+  return result;
+}
+
+/*
+ * Returns the length of the UTF-8 sequence at the start of the source, 0 if
+ * it is malformed or UTF8_INCOMPLETE if the source ends inside it.
+ */
+static size_t decode_utf8(const uint8_t source[], size_t source_size,
+                          uint32_t *codepoint) {
+  uint8_t lead = source[0];
+  size_t length;
+  uint32_t min_codepoint;
+  if (lead < 0x80) {
+    *codepoint = lead;
+    return 1;
+  } else if (lead >= 0xC2 && lead <= 0xDF) {
+    length = 2;
+    min_codepoint = 0x80;
+    *codepoint = lead & 0x1F;
+  } else if (lead >= 0xE0 && lead <= 0xEF) {
+    length = 3;
+    min_codepoint = 0x800;
+    *codepoint = lead & 0x0F;
+  } else if (lead >= 0xF0 && lead <= 0xF4) {
+    length = 4;
+    min_codepoint = 0x10000;
+    *codepoint = lead & 0x07;
+  } else {
+    return 0;
+  }
+  for (size_t i = 1; i < length; i++) {
+    if (i == source_size) {
+      return UTF8_INCOMPLETE;
+    }
+    if ((source[i] & 0xC0) != 0x80) {
+      return 0;
+    }
+    *codepoint = (*codepoint << 6) | (source[i] & 0x3F);
+  }
+  if (*codepoint < min_codepoint || *codepoint > MAX_UNICODE_CODEPOINT ||
+      (*codepoint >= 0xD800 && *codepoint <= 0xDFFF)) {
+    return 0;
+  }
+  return length;
+}
+
+bool utf8t_decode_block(utf8t_encoding_id_t encoding_id, const uint8_t source[],
+                        size_t source_size, uint8_t destination[],
+                        size_t destination_size, size_t *consumed_bytes,
+                        size_t *produced_bytes) {
+  encoding_entry_t *pencoding = encodings_registry[encoding_id];
+  bool copy_ascii_runs = utf8_tables[encoding_id] != NULL &&
+                         utf8_tables[encoding_id]->ascii_compatible;
+  size_t consumed = 0;
+  size_t produced = 0;
+  bool result =
+      pencoding != NULL && pencoding->translate_codepoint_func != NULL;
+  while (result && consumed < source_size &&
+         destination_size - produced >= MAX_BYTES_IN_CODEPAGES) {
+    size_t run_size = source_size - consumed;
+    // An ASCII byte takes one byte in the destination
+    if (run_size > destination_size - produced) {
+      run_size = destination_size - produced;
+    }
+    if (copy_ascii_runs && source[consumed] < 0x80 && run_size > 1 &&
+        source[consumed + 1] < 0x80) {
+      size_t ascii_size =
+          copy_ascii(source + consumed, run_size, destination + produced);
+      consumed += ascii_size;
+      produced += ascii_size;
+      continue;
+    }
+    uint32_t codepoint;
+    size_t sequence_size =
+        decode_utf8(source + consumed, source_size - consumed, &codepoint);
+    if (sequence_size == UTF8_INCOMPLETE) {
+      break;
+    }
+    size_t char_size = 0;
+    result = sequence_size != 0 && codepoint <= UINT16_MAX &&
+             pencoding->translate_codepoint_func(
+                 (uint16_t)codepoint, destination + produced, &char_size);
+    if (result) {
+      consumed += sequence_size;
+      produced += char_size;
+    }
+  }
+  *consumed_bytes = consumed;
+  *produced_bytes = produced;
+  return result;
+}
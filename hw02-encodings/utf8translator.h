@@ -20,7 +20,8 @@ typedef char **names_list_t;
 
 typedef struct utf8t_encoding_descriptor_t utf8t_encoding_descriptor_t;
 
-void utf8t_register_encoding(utf8t_encoding_descriptor_t *);
+// Returns false if the encoding cannot build its tables
+bool utf8t_register_encoding(utf8t_encoding_descriptor_t *);
 void utf8t_close();
 bool utf8t_get_aval_enc_names(names_list_t *names, size_t *count);
 bool utf8t_names_release(names_list_t *names);
@@ -32,5 +33,47 @@ bool utf8t_encode(utf8t_encoding_id_t encoding_id, uint8_t source_char[],
                   size_t source_char_size_bytes,
                   uint8_t buffer[MAX_BYTES_IN_UTF8_CODEPOINT],
                   size_t *result_bytes_size);
+/*
+ * Single-byte encodings convert every byte independently, so text in them (or
+ * UTF-8 text converted to them) can be split at any character boundary.
+ */
+bool utf8t_is_single_byte(utf8t_encoding_id_t encoding_id);
+/*
+ * Exact number of bytes utf8t_encode_block / utf8t_decode_block produce for
+ * the source, computed without converting it. Only single-byte encodings are
+ * supported; the size of malformed UTF-8 is not meaningful.
+ */
+bool utf8t_get_encoded_size(utf8t_encoding_id_t encoding_id,
+                            const uint8_t source[], size_t source_size,
+                            size_t *encoded_size);
+bool utf8t_get_decoded_size(utf8t_encoding_id_t encoding_id,
+                            const uint8_t source[], size_t source_size,
+                            size_t *decoded_size);
+/*
+ * Converts a block of text in the encoding to UTF-8. Stops at the end of the
+ * source, at an incomplete character at the end of the source or when less
+ * than MAX_BYTES_IN_UTF8_CODEPOINT bytes are left in the destination, so the
+ * rest can be passed in the next call. consumed_bytes and produced_bytes
+ * receive the number of bytes read from the source and written to the
+ * destination. Returns false if a character cannot be translated, in which
+ * case consumed_bytes is the offset of that character.
+ */
+bool utf8t_encode_block(utf8t_encoding_id_t encoding_id, const uint8_t source[],
+                        size_t source_size, uint8_t destination[],
+                        size_t destination_size, size_t *consumed_bytes,
+                        size_t *produced_bytes);
+/*
+ * The reverse of utf8t_encode_block: converts a block of UTF-8 text to the
+ * encoding. Malformed UTF-8 (overlong forms, surrogates, stray continuation
+ * bytes) is rejected like characters the encoding has no byte for. Stops at
+ * an incomplete sequence at the end of the source or when less than
+ * MAX_BYTES_IN_CODEPAGES bytes are left in the destination. Only runs of ASCII
+ * are copied with vector instructions, multibyte sequences are decoded one at
+ * a time.
+ */
+bool utf8t_decode_block(utf8t_encoding_id_t encoding_id, const uint8_t source[],
+                        size_t source_size, uint8_t destination[],
+                        size_t destination_size, size_t *consumed_bytes,
+                        size_t *produced_bytes);
 
 #endif
@@ -9,6 +9,9 @@ typedef bool (*utf8t_encode_res_reciever_fn)(uint8_t **codepoint_data,
 typedef bool (*utf8t_translate_character_fn)(uint8_t source_char[],
                                              size_t source_char_size,
                                              uint16_t *result_codepoint);
+typedef bool (*utf8t_translate_codepoint_fn)(uint16_t codepoint,
+                                             uint8_t result_char[],
+                                             size_t *result_char_size);
 typedef bool (*utf8t_register_encoding_fn)(
     encoding_entry_t *encoding_registry[]);
 
@@ -17,6 +20,8 @@ struct encoding_entry_t {
   char *code;
   utf8t_enc_codepoint_size_fn get_codepoint_size_func;
   utf8t_translate_character_fn translate_func;
+  // Reverse of translate_func, NULL if text cannot be converted to encoding
+  utf8t_translate_codepoint_fn translate_codepoint_func;
 };
 
 struct utf8t_encoding_descriptor_t {
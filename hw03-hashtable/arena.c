@@ -0,0 +1,117 @@
+#include "arena.h"
+#include <malloc.h>
+#include <stdalign.h>
+#include <stdint.h>
+
+typedef struct arena_slab {
+  struct arena_slab *next;
+  size_t size;
+  size_t used;
+  alignas(max_align_t) unsigned char data[];
+} arena_slab;
+
+struct arena {
+  arena_slab *current;
+  size_t slab_size;
+  size_t allocated;
+};
+
+static arena_slab *slab_create(size_t size) {
+  arena_slab *slab = malloc(sizeof(arena_slab) + size);
+  if (slab == NULL) {
+    return NULL;
+  }
+  slab->next = NULL;
+  slab->size = size;
+  slab->used = 0;
+  return slab;
+}
+
+arena *arena_init(size_t slab_size) {
+  if (slab_size == 0) {
+    slab_size = ARENA_DEFAULT_SLAB_SIZE;
+  }
+  arena *created_arena = malloc(sizeof(arena));
+  if (created_arena == NULL) {
+    return NULL;
+  }
+  created_arena->current = NULL;
+  created_arena->slab_size = slab_size;
+  created_arena->allocated = 0;
+  return created_arena;
+}
+
+void *arena_alloc(arena *arena, size_t size, size_t alignment) {
+  if (alignment == 0) {
+    alignment = 1;
+  }
+  arena_slab *slab = arena->current;
+  if (slab != NULL) {
+    size_t offset = (slab->used + alignment - 1) & ~(alignment - 1);
+    if (offset + size <= slab->size) {
+      slab->used = offset + size;
+      arena->allocated += size;
+      return slab->data + offset;
+    }
+  }
+  if (size > arena->slab_size / 4) {
+    // Large blocks get a dedicated slab behind the current one, so the
+    // free space left in the current slab is not wasted.
+    arena_slab *dedicated = slab_create(size);
+    if (dedicated == NULL) {
+      return NULL;
+    }
+    dedicated->used = size;
+    if (slab != NULL) {
+      dedicated->next = slab->next;
+      slab->next = dedicated;
+    } else {
+      arena->current = dedicated;
+    }
+    arena->allocated += size;
+    return dedicated->data;
+  }
+  arena_slab *new_slab = slab_create(arena->slab_size);
+  if (new_slab == NULL) {
+    return NULL;
+  }
+  new_slab->next = slab;
+  new_slab->used = size;
+  arena->current = new_slab;
+  arena->allocated += size;
+  return new_slab->data;
+}
+
+size_t arena_get_allocated(arena *arena) { return arena->allocated; }
+
+void arena_absorb(arena *destination, arena *source) {
+  arena_slab *first = source->current;
+  if (first != NULL) {
+    arena_slab *last = first;
+    while (last->next != NULL) {
+      last = last->next;
+    }
+    // The source slabs go behind the current one, which keeps its free space
+    if (destination->current != NULL) {
+      last->next = destination->current->next;
+      destination->current->next = first;
+    } else {
+      destination->current = first;
+    }
+  }
+  destination->allocated += source->allocated;
+  free(source);
+}
+
+void arena_free(arena *arena) {
+  if (arena == NULL) {
+    return;
+  }
+  arena_slab *slab = arena->current;
+  while (slab != NULL) {
+    arena_slab *next = slab->next;
+    free(slab);
+    slab = next;
+  }
+  free(arena);
+}
@@ -0,0 +1,23 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stddef.h>
+
+/*
+ * Bump allocator: memory is carved from large slabs and released only in bulk
+ * by arena_free.
+ */
+
+#define ARENA_DEFAULT_SLAB_SIZE (1024 * 1024)
+
+struct arena;
+typedef struct arena arena;
+
+arena *arena_init(size_t slab_size);
+void *arena_alloc(arena *arena, size_t size, size_t alignment);
+size_t arena_get_allocated(arena *arena);
+// Moves all memory of source into destination and frees source.
+void arena_absorb(arena *destination, arena *source);
+void arena_free(arena *arena);
+
+#endif
@@ -0,0 +1,153 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "hash_functions.h"
+#include "hash_table.h"
+
+#define DEFAULT_KEY_COUNT 1000000
+#define DEFAULT_SEED 42
+#define KEY_SIZE 24
+#define MIN_WORD_LENGTH 3
+#define MAX_WORD_LENGTH 14
+
+typedef struct {
+  const char *name;
+  char *keys;
+} key_set;
+
+static bool key_equals(const void *key1, const void *key2) {
+  return strcmp(key1, key2) == 0;
+}
+
+static double now_seconds(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static uint64_t next_random(uint64_t *state) {
+  *state ^= *state << 13;
+  *state ^= *state >> 7;
+  *state ^= *state << 17;
+  return *state;
+}
+
+static char *generate_sequential_keys(size_t key_count) {
+  char *keys = malloc(key_count * KEY_SIZE);
+  if (keys == NULL) {
+    return NULL;
+  }
+  for (size_t i = 0; i < key_count; i++) {
+    snprintf(keys + i * KEY_SIZE, KEY_SIZE, "key%zu", i);
+  }
+  return keys;
+}
+
+static char *generate_random_words(size_t key_count, uint64_t seed) {
+  char *keys = malloc(key_count * KEY_SIZE);
+  if (keys == NULL) {
+    return NULL;
+  }
+  uint64_t state = seed | 1;
+  for (size_t i = 0; i < key_count; i++) {
+    char *key = keys + i * KEY_SIZE;
+    size_t length = MIN_WORD_LENGTH +
+                    next_random(&state) % (MAX_WORD_LENGTH - MIN_WORD_LENGTH);
+    for (size_t j = 0; j < length; j++) {
+      key[j] = 'a' + next_random(&state) % 26;
+    }
+    key[length] = '\0';
+  }
+  return keys;
+}
+
+static void print_histogram(const hash_table_stats *stats) {
+  printf("    probe length histogram:");
+  for (size_t i = 0; i < HASH_TABLE_STATS_HISTOGRAM_SIZE; i++) {
+    printf(" %s%zu:%.3f", i == HASH_TABLE_STATS_HISTOGRAM_SIZE - 1 ? ">=" : "",
+           i, (double)stats->probe_length_histogram[i] / stats->size);
+  }
+  printf("\n");
+}
+
+static void run_benchmark(const key_set *keys, size_t key_count,
+                          const hash_function_descriptor *descriptor) {
+  double start = now_seconds();
+  unsigned int checksum = 0;
+  for (size_t i = 0; i < key_count; i++) {
+    checksum ^= descriptor->hash_function(keys->keys + i * KEY_SIZE);
+  }
+  double hash_time = now_seconds() - start;
+
+  hash_table *table = hash_table_init(descriptor->hash_function, key_equals,
+                                      key_count / 4);
+  if (table == NULL) {
+    fprintf(stderr, "Error creating hash table\n");
+    return;
+  }
+  start = now_seconds();
+  for (size_t i = 0; i < key_count; i++) {
+    const char *key = keys->keys + i * KEY_SIZE;
+    size_t value = i;
+    hash_table_put(table, key, strlen(key) + 1, &value, sizeof(value), NULL);
+  }
+  double insert_time = now_seconds() - start;
+  start = now_seconds();
+  size_t found = 0;
+  for (size_t i = 0; i < key_count; i++) {
+    if (hash_table_get(table, keys->keys + i * KEY_SIZE) != NULL) {
+      found++;
+    }
+  }
+  double lookup_time = now_seconds() - start;
+  hash_table_stats stats;
+  hash_table_get_stats(table, &stats);
+  printf("  %-8s hash %6.1f ns/op, insert %6.1f ns/op, lookup %6.1f ns/op, "
+         "probe avg %.3f max %zu (checksum %08x, found %zu)\n",
+         descriptor->name, hash_time / key_count * 1e9,
+         insert_time / key_count * 1e9, lookup_time / key_count * 1e9,
+         stats.average_probe_length, stats.max_probe_length, checksum, found);
+  print_histogram(&stats);
+  hash_table_free(table);
+}
+
+int main(int argc, char **argv) {
+  size_t key_count = argc > 1 ? strtoul(argv[1], NULL, 10) : DEFAULT_KEY_COUNT;
+  uint64_t seed = argc > 2 ? strtoull(argv[2], NULL, 10) : DEFAULT_SEED;
+  if (key_count == 0) {
+    printf("Usage: %s [key_count] [seed]\n", argv[0]);
+    return 1;
+  }
+  hash_functions_set_seed(seed);
+  key_set key_sets[] = {
+      {"sequential keys", generate_sequential_keys(key_count)},
+      {"random words", generate_random_words(key_count, seed)},
+  };
+  size_t function_count;
+  const hash_function_descriptor *functions =
+      hash_functions_get_all(&function_count);
+  int ret_val = 0;
+  for (size_t i = 0; i < sizeof(key_sets) / sizeof(key_sets[0]); i++) {
+    if (key_sets[i].keys == NULL) {
+      fprintf(stderr, "Cannot allocate keys\n");
+      ret_val = 2;
+      continue;
+    }
+    printf("%s, %zu keys, seed %llu\n", key_sets[i].name, key_count,
+           (unsigned long long)seed);
+    for (size_t j = 0; j < function_count; j++) {
+      run_benchmark(&key_sets[i], key_count, &functions[j]);
+    }
+    printf("\n");
+  }
+  for (size_t i = 0; i < sizeof(key_sets) / sizeof(key_sets[0]); i++) {
+    free(key_sets[i].keys);
+  }
+  return ret_val;
+}
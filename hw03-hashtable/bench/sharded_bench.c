@@ -0,0 +1,133 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "sharded_hash_table.h"
+
+#define DEFAULT_KEY_COUNT 2000000
+#define MAX_THREADS 32
+#define SHARD_COUNT 64
+#define KEY_SIZE 24
+
+typedef struct {
+  sharded_hash_table *table;
+  const char *keys;
+  size_t first_key;
+  size_t key_count;
+} worker_args;
+
+static unsigned int key_hash(const void *data) {
+  const unsigned char *key = data;
+  uint32_t hash = 2166136261u;
+  while (*key) {
+    hash = (hash ^ *key++) * 16777619u;
+  }
+  return hash ^ (hash >> 15);
+}
+
+static bool key_equals(const void *key1, const void *key2) {
+  return strcmp(key1, key2) == 0;
+}
+
+static double now_seconds(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void *insert_worker(void *arg) {
+  worker_args *args = arg;
+  for (size_t i = args->first_key; i < args->first_key + args->key_count;
+       i++) {
+    const char *key = args->keys + i * KEY_SIZE;
+    size_t value = i;
+    sharded_hash_table_put(args->table, key, strlen(key) + 1, &value,
+                           sizeof(value), NULL);
+  }
+  return NULL;
+}
+
+static void *lookup_worker(void *arg) {
+  worker_args *args = arg;
+  size_t found = 0;
+  for (size_t i = args->first_key; i < args->first_key + args->key_count;
+       i++) {
+    size_t value;
+    if (sharded_hash_table_get_copy(args->table, args->keys + i * KEY_SIZE,
+                                    &value, sizeof(value))) {
+      found++;
+    }
+  }
+  return (void *)found;
+}
+
+static double run_phase(void *(*worker)(void *), sharded_hash_table *table,
+                        const char *keys, size_t key_count,
+                        size_t thread_count) {
+  pthread_t threads[MAX_THREADS];
+  worker_args args[MAX_THREADS];
+  size_t per_thread = key_count / thread_count;
+  double start = now_seconds();
+  for (size_t t = 0; t < thread_count; t++) {
+    args[t].table = table;
+    args[t].keys = keys;
+    args[t].first_key = t * per_thread;
+    args[t].key_count =
+        t == thread_count - 1 ? key_count - t * per_thread : per_thread;
+    pthread_create(&threads[t], NULL, worker, &args[t]);
+  }
+  for (size_t t = 0; t < thread_count; t++) {
+    pthread_join(threads[t], NULL);
+  }
+  return now_seconds() - start;
+}
+
+static void run_benchmark(const char *name, const char *keys,
+                          size_t key_count, size_t shard_count) {
+  printf("%s (%zu shards)\n", name, shard_count);
+  printf("%8s %16s %16s\n", "threads", "insert Mops/s", "lookup Mops/s");
+  for (size_t thread_count = 1; thread_count <= MAX_THREADS;
+       thread_count *= 2) {
+    sharded_hash_table *table =
+        sharded_hash_table_init(key_hash, key_equals, 1024, HASH_TABLE_ARENA,
+                                sizeof(size_t), shard_count);
+    if (table == NULL) {
+      fprintf(stderr, "Error creating hash table\n");
+      return;
+    }
+    double insert_time =
+        run_phase(insert_worker, table, keys, key_count, thread_count);
+    double lookup_time =
+        run_phase(lookup_worker, table, keys, key_count, thread_count);
+    printf("%8zu %16.2f %16.2f\n", thread_count,
+           key_count / insert_time / 1e6, key_count / lookup_time / 1e6);
+    sharded_hash_table_free(table);
+  }
+  printf("\n");
+}
+
+int main(int argc, char **argv) {
+  size_t key_count = argc > 1 ? strtoul(argv[1], NULL, 10) : DEFAULT_KEY_COUNT;
+  if (key_count == 0) {
+    printf("Usage: %s [key_count]\n", argv[0]);
+    return 1;
+  }
+  char *keys = malloc(key_count * KEY_SIZE);
+  if (keys == NULL) {
+    fprintf(stderr, "Cannot allocate keys\n");
+    return 2;
+  }
+  for (size_t i = 0; i < key_count; i++) {
+    snprintf(keys + i * KEY_SIZE, KEY_SIZE, "key%zu", i);
+  }
+  run_benchmark("Single lock", keys, key_count, 1);
+  run_benchmark("Sharded", keys, key_count, SHARD_COUNT);
+  free(keys);
+  return 0;
+}
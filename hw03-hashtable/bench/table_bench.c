@@ -0,0 +1,501 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#ifdef __GLIBC__
+#include <malloc.h>
+#if __GLIBC_PREREQ(2, 33)
+#define HAVE_MALLINFO2
+#endif
+#endif
+
+#include "hash_functions.h"
+#include "hash_table.h"
+#include "tokenizer.h"
+
+#define DEFAULT_KEY_COUNT 1000000
+#define DEFAULT_SEED 42
+#define HASH_FUNCTION "wy"
+#define KEY_SIZE 24
+#define MIN_WORD_LENGTH 3
+#define MAX_WORD_LENGTH 14
+#define INITIAL_TABLE_SIZE 1000
+#define ZIPF_EXPONENT 1.0
+// Every LATENCY_SAMPLE_RATE-th operation is timed individually
+#define LATENCY_SAMPLE_RATE 16
+/*
+ * Adversarial keys all have the top ADVERSARIAL_BITS bits of the mixed hash
+ * equal to zero, so their home slots fall into the first 1/2^ADVERSARIAL_BITS
+ * of the slot array whatever its size.
+ */
+#define ADVERSARIAL_BITS 6
+#define ADVERSARIAL_KEY_DIVISOR 64
+#define FIBONACCI_MULTIPLIER 2654435769u
+#define WORD_COUNT_TEXT_SIZE (64 * 1024 * 1024)
+#define WORDS_PER_LINE 16
+#define COMMAND_SIZE 1024
+
+typedef enum { OP_INSERT, OP_HIT, OP_MISS, OP_DELETE, OP_COUNT } operation;
+
+static const char *const operation_names[OP_COUNT] = {"insert", "hit", "miss",
+                                                      "delete"};
+
+typedef struct {
+  const char *name;
+  size_t key_count;
+  char *keys;
+  char *missing_keys;
+  // Order of keys looked up by the hit benchmark
+  size_t *queries;
+} key_set;
+
+typedef struct {
+  const char *name;
+  unsigned int flags;
+} table_mode;
+
+static const table_mode table_modes[] = {
+    {"default", 0},
+    {"arena", HASH_TABLE_ARENA},
+    {"robin hood", HASH_TABLE_ROBIN_HOOD},
+    {"incremental", HASH_TABLE_INCREMENTAL_REHASH},
+    {"inline keys", HASH_TABLE_INLINE_KEYS},
+    {"arena+inline", HASH_TABLE_ARENA | HASH_TABLE_INLINE_KEYS},
+};
+
+typedef struct {
+  double throughput[OP_COUNT];
+  double p99_latency[OP_COUNT];
+  double bytes_per_entry;
+  hash_table_stats stats;
+} bench_result;
+
+static hash_table_hash_fn key_hash = NULL;
+
+static bool key_equals(const void *key1, const void *key2) {
+  return strcmp(key1, key2) == 0;
+}
+
+static double now_seconds(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static uint64_t next_random(uint64_t *state) {
+  *state ^= *state << 13;
+  *state ^= *state >> 7;
+  *state ^= *state << 17;
+  return *state;
+}
+
+static double next_random_double(uint64_t *state) {
+  return (next_random(state) >> 11) * (1.0 / (1ull << 53));
+}
+
+// mallinfo2 is glibc-only, elsewhere B/entry is reported as 0
+static size_t heap_in_use(void) {
+#ifdef HAVE_MALLINFO2
+  struct mallinfo2 info = mallinfo2();
+  return info.uordblks + info.hblkhd;
+#else
+  return 0;
+#endif
+}
+
+static void random_word(char *key, uint64_t *state, char first_letter) {
+  size_t length = MIN_WORD_LENGTH +
+                  next_random(state) % (MAX_WORD_LENGTH - MIN_WORD_LENGTH);
+  for (size_t j = 0; j < length; j++) {
+    key[j] = first_letter + next_random(state) % 26;
+  }
+  key[length] = '\0';
+}
+
+static bool is_adversarial(const char *key) {
+  uint32_t mixed = (uint32_t)key_hash(key) * FIBONACCI_MULTIPLIER;
+  return mixed >> (32 - ADVERSARIAL_BITS) == 0;
+}
+
+/*
+ * Fills key_count random words. Each word ends with its index, so all keys
+ * are distinct as hash_table_build requires. Missing keys are upper case, so
+ * they are never present in a table of lower case keys.
+ */
+static char *generate_words(size_t key_count, uint64_t *state,
+                            char first_letter, bool adversarial) {
+  char *keys = malloc(key_count * KEY_SIZE);
+  if (keys == NULL) {
+    return NULL;
+  }
+  for (size_t i = 0; i < key_count; i++) {
+    char *key = keys + i * KEY_SIZE;
+    do {
+      random_word(key, state, first_letter);
+      size_t length = strlen(key);
+      snprintf(key + length, KEY_SIZE - length, "%zu", i);
+    } while (adversarial && !is_adversarial(key));
+  }
+  return keys;
+}
+
+static size_t *generate_uniform_queries(size_t key_count, uint64_t *state) {
+  size_t *queries = malloc(key_count * sizeof(size_t));
+  if (queries == NULL) {
+    return NULL;
+  }
+  for (size_t i = 0; i < key_count; i++) {
+    queries[i] = next_random(state) % key_count;
+  }
+  return queries;
+}
+
+// Key i is queried with probability proportional to 1 / (i + 1)^s
+static size_t *generate_zipf_queries(size_t key_count, uint64_t *state) {
+  size_t *queries = malloc(key_count * sizeof(size_t));
+  double *cdf = malloc(key_count * sizeof(double));
+  if (queries == NULL || cdf == NULL) {
+    free(queries);
+    free(cdf);
+    return NULL;
+  }
+  double sum = 0;
+  for (size_t i = 0; i < key_count; i++) {
+    sum += 1.0 / pow(i + 1, ZIPF_EXPONENT);
+    cdf[i] = sum;
+  }
+  for (size_t i = 0; i < key_count; i++) {
+    double target = next_random_double(state) * sum;
+    size_t low = 0;
+    size_t high = key_count - 1;
+    while (low < high) {
+      size_t middle = low + (high - low) / 2;
+      if (cdf[middle] < target) {
+        low = middle + 1;
+      } else {
+        high = middle;
+      }
+    }
+    queries[i] = low;
+  }
+  free(cdf);
+  return queries;
+}
+
+static const char *key_at(const char *keys, size_t index) {
+  return keys + index * KEY_SIZE;
+}
+
+static bool run_operation(hash_table *table, const key_set *keys,
+                          operation op, size_t index) {
+  const char *key;
+  switch (op) {
+  case OP_INSERT:
+    key = key_at(keys->keys, index);
+    return hash_table_put(table, key, strlen(key) + 1, &index, sizeof(index),
+                          NULL) == 0;
+  case OP_HIT:
+    return hash_table_get(table, key_at(keys->keys, keys->queries[index])) !=
+           NULL;
+  case OP_MISS:
+    return hash_table_get(table, key_at(keys->missing_keys, index)) == NULL;
+  case OP_DELETE:
+    return hash_table_delete(table, key_at(keys->keys, index));
+  default:
+    return false;
+  }
+}
+
+static int compare_doubles(const void *a, const void *b) {
+  double first = *(const double *)a;
+  double second = *(const double *)b;
+  return (first > second) - (first < second);
+}
+
+static double percentile(double *samples, size_t count, double fraction) {
+  if (count == 0) {
+    return 0;
+  }
+  qsort(samples, count, sizeof(double), compare_doubles);
+  return samples[(size_t)(fraction * (count - 1))];
+}
+
+/*
+ * Runs every operation over the whole key set: inserts into an empty table,
+ * hits, misses and finally deletes of all keys. Memory and probe lengths are
+ * measured right after the inserts.
+ */
+static bool run_benchmark(const key_set *keys, const table_mode *mode,
+                          bench_result *result) {
+  size_t key_count = keys->key_count;
+  double *samples =
+      malloc((key_count / LATENCY_SAMPLE_RATE + 1) * sizeof(double));
+  if (samples == NULL) {
+    return false;
+  }
+  size_t heap_before = heap_in_use();
+  hash_table *table = hash_table_init_ex(key_hash, key_equals,
+                                         INITIAL_TABLE_SIZE, mode->flags,
+                                         sizeof(size_t));
+  if (table == NULL) {
+    free(samples);
+    return false;
+  }
+  for (operation op = 0; op < OP_COUNT; op++) {
+    size_t sample_count = 0;
+    double start = now_seconds();
+    for (size_t i = 0; i < key_count; i++) {
+      if (i % LATENCY_SAMPLE_RATE != 0) {
+        run_operation(table, keys, op, i);
+        continue;
+      }
+      double operation_start = now_seconds();
+      run_operation(table, keys, op, i);
+      samples[sample_count++] = now_seconds() - operation_start;
+    }
+    double elapsed = now_seconds() - start;
+    result->throughput[op] = key_count / elapsed;
+    result->p99_latency[op] = percentile(samples, sample_count, 0.99);
+    if (op == OP_INSERT) {
+      size_t size = hash_table_get_size(table);
+      result->bytes_per_entry =
+          (double)(heap_in_use() - heap_before) / (size > 0 ? size : 1);
+      hash_table_get_stats(table, &result->stats);
+    }
+  }
+  hash_table_free(table);
+  free(samples);
+  return true;
+}
+
+static void print_results(const key_set *keys) {
+  printf("%s, %zu keys (throughput in Mops/s, p99 latency in ns)\n",
+         keys->name, keys->key_count);
+  printf("  %-12s", "mode");
+  for (operation op = 0; op < OP_COUNT; op++) {
+    printf(" %7s %6s", operation_names[op], "p99");
+  }
+  printf(" %8s %9s %5s\n", "B/entry", "probe avg", "max");
+  for (size_t i = 0; i < sizeof(table_modes) / sizeof(table_modes[0]); i++) {
+    bench_result result;
+    if (!run_benchmark(keys, &table_modes[i], &result)) {
+      fprintf(stderr, "Cannot run benchmark\n");
+      continue;
+    }
+    printf("  %-12s", table_modes[i].name);
+    for (operation op = 0; op < OP_COUNT; op++) {
+      printf(" %7.2f %6.0f", result.throughput[op] / 1e6,
+             result.p99_latency[op] * 1e9);
+    }
+    printf(" %8.1f %9.3f %5zu\n", result.bytes_per_entry,
+           result.stats.average_probe_length, result.stats.max_probe_length);
+  }
+  printf("\n");
+}
+
+static double time_puts(const key_set *keys, unsigned int flags,
+                        bool reserve) {
+  hash_table *table = hash_table_init_ex(key_hash, key_equals,
+                                         INITIAL_TABLE_SIZE, flags,
+                                         sizeof(size_t));
+  if (table == NULL) {
+    return 0;
+  }
+  double start = now_seconds();
+  if (reserve) {
+    hash_table_reserve(table, keys->key_count);
+  }
+  for (size_t i = 0; i < keys->key_count; i++) {
+    run_operation(table, keys, OP_INSERT, i);
+  }
+  double elapsed = now_seconds() - start;
+  hash_table_free(table);
+  return elapsed;
+}
+
+static double time_build(const void *const *key_pointers,
+                         const size_t *key_sizes, const size_t *values,
+                         size_t key_count, unsigned int flags,
+                         size_t thread_count) {
+  double start = now_seconds();
+  hash_table *table =
+      hash_table_build(key_hash, key_equals, flags, sizeof(size_t),
+                       key_pointers, key_sizes, values, key_count,
+                       thread_count);
+  double elapsed = now_seconds() - start;
+  if (table == NULL) {
+    return 0;
+  }
+  hash_table_free(table);
+  return elapsed;
+}
+
+// Filling a table one put at a time, with and without reserve, and bulk build
+static void run_build_benchmark(const key_set *keys, unsigned int flags) {
+  size_t key_count = keys->key_count;
+  const void **key_pointers = malloc(key_count * sizeof(void *));
+  size_t *key_sizes = malloc(key_count * sizeof(size_t));
+  size_t *values = malloc(key_count * sizeof(size_t));
+  if (key_pointers == NULL || key_sizes == NULL || values == NULL) {
+    fprintf(stderr, "Cannot allocate keys\n");
+    goto release_resources;
+  }
+  for (size_t i = 0; i < key_count; i++) {
+    key_pointers[i] = key_at(keys->keys, i);
+    key_sizes[i] = strlen(key_pointers[i]) + 1;
+    values[i] = i;
+  }
+  long cpu_count = sysconf(_SC_NPROCESSORS_ONLN);
+  size_t thread_count = cpu_count > 1 ? (size_t)cpu_count : 2;
+  printf("building from %s, %zu keys (Mops/s)\n", keys->name, key_count);
+  printf("  %-24s %7.2f\n", "put",
+         key_count / time_puts(keys, flags, false) / 1e6);
+  printf("  %-24s %7.2f\n", "reserve + put",
+         key_count / time_puts(keys, flags, true) / 1e6);
+  printf("  %-24s %7.2f\n", "build",
+         key_count /
+             time_build(key_pointers, key_sizes, values, key_count, flags, 1) /
+             1e6);
+  char label[48];
+  snprintf(label, sizeof(label), "build, %zu threads", thread_count);
+  printf("  %-24s %7.2f\n", label,
+         key_count /
+             time_build(key_pointers, key_sizes, values, key_count, flags,
+                        thread_count) /
+             1e6);
+  printf("\n");
+release_resources:
+  free(key_pointers);
+  free(key_sizes);
+  free(values);
+}
+
+// Text of Zipf-distributed words, like a natural language corpus
+static bool write_text(FILE *file, const key_set *keys, size_t text_size) {
+  size_t written = 0;
+  for (size_t i = 0; written < text_size; i++) {
+    const char *word = key_at(keys->keys, keys->queries[i % keys->key_count]);
+    size_t length = strlen(word);
+    if (fwrite(word, 1, length, file) != length ||
+        fputc((i + 1) % WORDS_PER_LINE == 0 ? '\n' : ' ', file) == EOF) {
+      return false;
+    }
+    written += length + 1;
+  }
+  return true;
+}
+
+static void run_word_count_benchmark(const char *word_count_path,
+                                     const key_set *keys) {
+  if (access(word_count_path, X_OK) != 0) {
+    printf("word_count benchmark skipped: %s is not executable\n",
+           word_count_path);
+    return;
+  }
+  char path[] = "/tmp/table_bench_XXXXXX";
+  int fd = mkstemp(path);
+  FILE *file = fd >= 0 ? fdopen(fd, "w") : NULL;
+  if (file == NULL) {
+    perror("Cannot create text file");
+    if (fd >= 0) {
+      close(fd);
+      unlink(path);
+    }
+    return;
+  }
+  bool written = write_text(file, keys, WORD_COUNT_TEXT_SIZE);
+  if (fclose(file) != 0 || !written) {
+    perror("Cannot write text file");
+    unlink(path);
+    return;
+  }
+  static const char *const options[] = {"", "-j 0", "--top 10"};
+  printf("word_count, %d MiB of %s, %s tokenizer\n",
+         WORD_COUNT_TEXT_SIZE / (1024 * 1024), keys->name,
+         tokenizer_simd_name());
+  for (size_t i = 0; i < sizeof(options) / sizeof(options[0]); i++) {
+    char command[COMMAND_SIZE];
+    snprintf(command, sizeof(command), "%s %s %s > /dev/null",
+             word_count_path, options[i], path);
+    double start = now_seconds();
+    int status = system(command);
+    double elapsed = now_seconds() - start;
+    if (status != 0) {
+      fprintf(stderr, "Command failed: %s\n", command);
+      continue;
+    }
+    printf("  %-12s %8.1f MB/s\n", options[i][0] != '\0' ? options[i] : "-",
+           WORD_COUNT_TEXT_SIZE / elapsed / 1e6);
+  }
+  unlink(path);
+}
+
+static void free_key_set(key_set *keys) {
+  free(keys->keys);
+  free(keys->missing_keys);
+  free(keys->queries);
+}
+
+int main(int argc, char **argv) {
+  size_t key_count = argc > 1 ? strtoul(argv[1], NULL, 10) : DEFAULT_KEY_COUNT;
+  uint64_t seed = argc > 2 ? strtoull(argv[2], NULL, 10) : DEFAULT_SEED;
+  if (key_count == 0) {
+    printf("Usage: %s [key_count] [seed] [word_count]\n", argv[0]);
+    return 1;
+  }
+  hash_functions_set_seed(seed);
+  key_hash = hash_functions_get_by_name(HASH_FUNCTION);
+  uint64_t state = seed | 1;
+  size_t adversarial_count = key_count / ADVERSARIAL_KEY_DIVISOR + 1;
+  key_set key_sets[] = {
+      {"uniform keys", key_count, generate_words(key_count, &state, 'a', false),
+       generate_words(key_count, &state, 'A', false),
+       generate_uniform_queries(key_count, &state)},
+      {"zipfian keys", key_count, generate_words(key_count, &state, 'a', false),
+       generate_words(key_count, &state, 'A', false),
+       generate_zipf_queries(key_count, &state)},
+      {"adversarial keys", adversarial_count,
+       generate_words(adversarial_count, &state, 'a', true),
+       generate_words(adversarial_count, &state, 'A', true),
+       generate_uniform_queries(adversarial_count, &state)},
+  };
+  size_t key_set_count = sizeof(key_sets) / sizeof(key_sets[0]);
+  int ret_val = 0;
+  printf("hash function %s, seed %llu\n\n", HASH_FUNCTION,
+         (unsigned long long)seed);
+  for (size_t i = 0; i < key_set_count; i++) {
+    if (key_sets[i].keys == NULL || key_sets[i].missing_keys == NULL ||
+        key_sets[i].queries == NULL) {
+      fprintf(stderr, "Cannot allocate keys\n");
+      ret_val = 2;
+      continue;
+    }
+    print_results(&key_sets[i]);
+  }
+  if (key_sets[0].keys != NULL) {
+    run_build_benchmark(&key_sets[0],
+                        HASH_TABLE_ARENA | HASH_TABLE_INLINE_KEYS);
+  }
+  // By default word_count is looked up next to the benchmark
+  char word_count_path[COMMAND_SIZE / 2] = "./word_count";
+  const char *last_slash = strrchr(argv[0], '/');
+  if (argc > 3) {
+    snprintf(word_count_path, sizeof(word_count_path), "%s", argv[3]);
+  } else if (last_slash != NULL) {
+    snprintf(word_count_path, sizeof(word_count_path), "%.*s/word_count",
+             (int)(last_slash - argv[0]), argv[0]);
+  }
+  if (key_sets[1].queries != NULL && key_sets[1].keys != NULL) {
+    run_word_count_benchmark(word_count_path, &key_sets[1]);
+  }
+  for (size_t i = 0; i < key_set_count; i++) {
+    free_key_set(&key_sets[i]);
+  }
+  return ret_val;
+}
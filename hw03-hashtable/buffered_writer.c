@@ -0,0 +1,84 @@
+#include "buffered_writer.h"
+#include <malloc.h>
+#include <string.h>
+
+#define MAX_DECIMAL_DIGITS 20
+
+struct buffered_writer {
+  FILE *stream;
+  char *buffer;
+  size_t capacity;
+  size_t used;
+  bool failed;
+};
+
+buffered_writer *buffered_writer_init(FILE *stream, size_t capacity) {
+  if (capacity == 0) {
+    capacity = BUFFERED_WRITER_DEFAULT_CAPACITY;
+  }
+  buffered_writer *writer = malloc(sizeof(buffered_writer));
+  if (writer == NULL) {
+    return NULL;
+  }
+  writer->buffer = malloc(capacity);
+  if (writer->buffer == NULL) {
+    free(writer);
+    return NULL;
+  }
+  writer->stream = stream;
+  writer->capacity = capacity;
+  writer->used = 0;
+  writer->failed = false;
+  return writer;
+}
+
+bool buffered_writer_flush(buffered_writer *writer) {
+  if (writer->used > 0 &&
+      fwrite(writer->buffer, 1, writer->used, writer->stream) !=
+          writer->used) {
+    writer->failed = true;
+  }
+  writer->used = 0;
+  return !writer->failed;
+}
+
+bool buffered_writer_write(buffered_writer *writer, const char *data,
+                           size_t size) {
+  if (writer->used + size > writer->capacity) {
+    buffered_writer_flush(writer);
+    if (size > writer->capacity) {
+      if (fwrite(data, 1, size, writer->stream) != size) {
+        writer->failed = true;
+      }
+      return !writer->failed;
+    }
+  }
+  memcpy(writer->buffer + writer->used, data, size);
+  writer->used += size;
+  return !writer->failed;
+}
+
+bool buffered_writer_write_string(buffered_writer *writer, const char *string) {
+  return buffered_writer_write(writer, string, strlen(string));
+}
+
+bool buffered_writer_write_size(buffered_writer *writer, size_t value) {
+  char digits[MAX_DECIMAL_DIGITS];
+  size_t position = sizeof(digits);
+  do {
+    digits[--position] = '0' + value % 10;
+    value /= 10;
+  } while (value != 0);
+  return buffered_writer_write(writer, digits + position,
+                               sizeof(digits) - position);
+}
+
+bool buffered_writer_free(buffered_writer *writer) {
+  if (writer == NULL) {
+    return true;
+  }
+  bool ret_val = buffered_writer_flush(writer);
+  free(writer->buffer);
+  free(writer);
+  return ret_val;
+}
@@ -0,0 +1,27 @@
+#ifndef BUFFERED_WRITER_H
+#define BUFFERED_WRITER_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+
+/*
+ * Accumulates output in a large buffer and hands it to the stream in big
+ * blocks, instead of going through printf formatting for every line.
+ */
+
+#define BUFFERED_WRITER_DEFAULT_CAPACITY (1024 * 1024)
+
+struct buffered_writer;
+typedef struct buffered_writer buffered_writer;
+
+buffered_writer *buffered_writer_init(FILE *stream, size_t capacity);
+bool buffered_writer_write(buffered_writer *writer, const char *data,
+                           size_t size);
+bool buffered_writer_write_string(buffered_writer *writer, const char *string);
+bool buffered_writer_write_size(buffered_writer *writer, size_t value);
+bool buffered_writer_flush(buffered_writer *writer);
+// Flushes pending output; returns false if any write failed.
+bool buffered_writer_free(buffered_writer *writer);
+
+#endif
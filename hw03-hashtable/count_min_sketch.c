@@ -0,0 +1,81 @@
+#include "count_min_sketch.h"
+#include <malloc.h>
+
+#define MAX_DEPTH 16
+
+struct count_min_sketch {
+  size_t width;
+  size_t depth;
+  uint64_t *counters;
+};
+
+count_min_sketch *count_min_sketch_init(size_t width, size_t depth) {
+  if (width == 0 || (width & (width - 1)) != 0 || depth == 0 ||
+      depth > MAX_DEPTH) {
+    return NULL;
+  }
+  count_min_sketch *sketch = malloc(sizeof(count_min_sketch));
+  if (sketch == NULL) {
+    return NULL;
+  }
+  sketch->counters = calloc(width * depth, sizeof(uint64_t));
+  if (sketch->counters == NULL) {
+    free(sketch);
+    return NULL;
+  }
+  sketch->width = width;
+  sketch->depth = depth;
+  return sketch;
+}
+
+// Row hashes are derived from one 64-bit hash by double hashing.
+static size_t cell_index(const count_min_sketch *sketch, uint64_t hash,
+                         size_t row) {
+  uint32_t h1 = (uint32_t)hash;
+  uint32_t h2 = (uint32_t)(hash >> 32) | 1;
+  return row * sketch->width + ((h1 + row * h2) & (sketch->width - 1));
+}
+
+uint64_t count_min_sketch_estimate(const count_min_sketch *sketch,
+                                   uint64_t hash) {
+  uint64_t estimate = UINT64_MAX;
+  for (size_t row = 0; row < sketch->depth; row++) {
+    uint64_t counter = sketch->counters[cell_index(sketch, hash, row)];
+    if (counter < estimate) {
+      estimate = counter;
+    }
+  }
+  return estimate;
+}
+
+uint64_t count_min_sketch_add(count_min_sketch *sketch, uint64_t hash) {
+  size_t cells[MAX_DEPTH];
+  uint64_t estimate = UINT64_MAX;
+  for (size_t row = 0; row < sketch->depth; row++) {
+    cells[row] = cell_index(sketch, hash, row);
+    if (sketch->counters[cells[row]] < estimate) {
+      estimate = sketch->counters[cells[row]];
+    }
+  }
+  estimate++;
+  // Conservative update: only counters below the new estimate are raised
+  for (size_t row = 0; row < sketch->depth; row++) {
+    if (sketch->counters[cells[row]] < estimate) {
+      sketch->counters[cells[row]] = estimate;
+    }
+  }
+  return estimate;
+}
+
+size_t count_min_sketch_get_memory(const count_min_sketch *sketch) {
+  return sizeof(count_min_sketch) +
+         sketch->width * sketch->depth * sizeof(uint64_t);
+}
+
+void count_min_sketch_free(count_min_sketch *sketch) {
+  if (sketch == NULL) {
+    return;
+  }
+  free(sketch->counters);
+  free(sketch);
+}
@@ -0,0 +1,25 @@
+#ifndef COUNT_MIN_SKETCH_H
+#define COUNT_MIN_SKETCH_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Count-Min Sketch with conservative update: a fixed depth x width matrix of
+ * counters. Estimates never undercount; overcounting is bounded by
+ * e * total / width with probability 1 - e^-depth.
+ */
+
+struct count_min_sketch;
+typedef struct count_min_sketch count_min_sketch;
+
+count_min_sketch *count_min_sketch_init(size_t width, size_t depth);
+// Adds one occurrence of the item with the given 64-bit hash and returns its
+// new estimated count.
+uint64_t count_min_sketch_add(count_min_sketch *sketch, uint64_t hash);
+uint64_t count_min_sketch_estimate(const count_min_sketch *sketch,
+                                   uint64_t hash);
+size_t count_min_sketch_get_memory(const count_min_sketch *sketch);
+void count_min_sketch_free(count_min_sketch *sketch);
+
+#endif
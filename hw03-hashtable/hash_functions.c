@@ -0,0 +1,157 @@
+#include "hash_functions.h"
+#include <string.h>
+
+#define DEFAULT_SEED 42
+
+#define XX_PRIME_1 2654435761u
+#define XX_PRIME_2 2246822519u
+#define XX_PRIME_3 3266489917u
+#define XX_PRIME_4 668265263u
+#define XX_PRIME_5 374761393u
+
+#define WY_P0 0xa0761d6478bd642full
+#define WY_P1 0xe7037ed1a0b428dbull
+
+__extension__ typedef unsigned __int128 uint128_t;
+
+static uint64_t hash_seed = DEFAULT_SEED;
+
+static const hash_function_descriptor hash_functions[] = {
+    {"mul101", hash_string_mul101},
+    {"fnv1a", hash_string_fnv1a},
+    {"xx", hash_string_xx},
+    {"wy", hash_string_wy},
+};
+
+void hash_functions_set_seed(uint64_t seed) { hash_seed = seed; }
+
+uint64_t hash_functions_get_seed(void) { return hash_seed; }
+
+static uint32_t read32(const unsigned char *data) {
+  uint32_t value;
+  memcpy(&value, data, sizeof(value));
+  return value;
+}
+
+static uint64_t read64(const unsigned char *data) {
+  uint64_t value;
+  memcpy(&value, data, sizeof(value));
+  return value;
+}
+
+static uint32_t rotl32(uint32_t value, int bits) {
+  return (value << bits) | (value >> (32 - bits));
+}
+
+static uint32_t fmix32(uint32_t hash) {
+  hash ^= hash >> 16;
+  hash *= 0x85ebca6bu;
+  hash ^= hash >> 13;
+  hash *= 0xc2b2ae35u;
+  hash ^= hash >> 16;
+  return hash;
+}
+
+unsigned int hash_string_mul101(const void *key) {
+  const char *word = key;
+  unsigned int hash = hash_seed;
+  while (*word) {
+    hash = hash * 101 + *word++;
+  }
+  return hash;
+}
+
+unsigned int hash_string_fnv1a(const void *key) {
+  const unsigned char *data = key;
+  size_t length = strlen(key);
+  uint64_t hash = 0xcbf29ce484222325ull ^ hash_seed;
+  size_t i = 0;
+  for (; i + sizeof(uint64_t) <= length; i += sizeof(uint64_t)) {
+    hash = (hash ^ read64(data + i)) * 0x100000001b3ull;
+  }
+  for (; i < length; i++) {
+    hash = (hash ^ data[i]) * 0x100000001b3ull;
+  }
+  return fmix32((uint32_t)(hash ^ (hash >> 32)));
+}
+
+static uint32_t xx_round(uint32_t accumulator, uint32_t lane) {
+  accumulator += lane * XX_PRIME_2;
+  return rotl32(accumulator, 13) * XX_PRIME_1;
+}
+
+unsigned int hash_string_xx(const void *key) {
+  const unsigned char *data = key;
+  size_t length = strlen(key);
+  uint32_t seed = (uint32_t)hash_seed;
+  uint32_t hash;
+  size_t i = 0;
+  if (length >= 16) {
+    uint32_t v1 = seed + XX_PRIME_1 + XX_PRIME_2;
+    uint32_t v2 = seed + XX_PRIME_2;
+    uint32_t v3 = seed;
+    uint32_t v4 = seed - XX_PRIME_1;
+    for (; i + 16 <= length; i += 16) {
+      v1 = xx_round(v1, read32(data + i));
+      v2 = xx_round(v2, read32(data + i + 4));
+      v3 = xx_round(v3, read32(data + i + 8));
+      v4 = xx_round(v4, read32(data + i + 12));
+    }
+    hash = rotl32(v1, 1) + rotl32(v2, 7) + rotl32(v3, 12) + rotl32(v4, 18);
+  } else {
+    hash = seed + XX_PRIME_5;
+  }
+  hash += (uint32_t)length;
+  for (; i + 4 <= length; i += 4) {
+    hash = rotl32(hash + read32(data + i) * XX_PRIME_3, 17) * XX_PRIME_4;
+  }
+  for (; i < length; i++) {
+    hash = rotl32(hash + data[i] * XX_PRIME_5, 11) * XX_PRIME_1;
+  }
+  hash ^= hash >> 15;
+  hash *= XX_PRIME_2;
+  hash ^= hash >> 13;
+  hash *= XX_PRIME_3;
+  hash ^= hash >> 16;
+  return hash;
+}
+
+static uint64_t wy_mix(uint64_t a, uint64_t b) {
+  uint128_t product = (uint128_t)a * b;
+  return (uint64_t)product ^ (uint64_t)(product >> 64);
+}
+
+uint64_t hash_bytes_wy64(const void *key, size_t length) {
+  const unsigned char *data = key;
+  uint64_t seed = hash_seed ^ WY_P0;
+  size_t i = 0;
+  for (; i + 16 < length; i += 16) {
+    seed = wy_mix(read64(data + i) ^ WY_P1, read64(data + i + 8) ^ seed);
+  }
+  // Up to 16 tail bytes, zero padded
+  unsigned char tail[16] = {0};
+  memcpy(tail, data + i, length - i);
+  uint64_t a = read64(tail);
+  uint64_t b = read64(tail + 8);
+  return wy_mix(WY_P1 ^ length, wy_mix(a ^ WY_P1, b ^ seed));
+}
+
+unsigned int hash_string_wy(const void *key) {
+  uint64_t hash = hash_bytes_wy64(key, strlen(key));
+  return (uint32_t)(hash ^ (hash >> 32));
+}
+
+const hash_function_descriptor *hash_functions_get_all(size_t *count) {
+  *count = sizeof(hash_functions) / sizeof(hash_functions[0]);
+  return hash_functions;
+}
+
+hash_table_hash_fn hash_functions_get_by_name(const char *name) {
+  for (size_t i = 0; i < sizeof(hash_functions) / sizeof(hash_functions[0]);
+       i++) {
+    if (strcmp(hash_functions[i].name, name) == 0) {
+      return hash_functions[i].hash_function;
+    }
+  }
+  return NULL;
+}
@@ -0,0 +1,33 @@
+#ifndef HASH_FUNCTIONS_H
+#define HASH_FUNCTIONS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "hash_table.h"
+
+/*
+ * Built-in hash functions for NUL-terminated string keys, usable as
+ * hash_table_hash_fn. Except for mul101 they read the key a machine word at a
+ * time and finish with an avalanche step, so every output bit depends on
+ * every input byte. All of them are seeded by hash_functions_set_seed.
+ */
+
+typedef struct {
+  const char *name;
+  hash_table_hash_fn hash_function;
+} hash_function_descriptor;
+
+void hash_functions_set_seed(uint64_t seed);
+uint64_t hash_functions_get_seed(void);
+unsigned int hash_string_mul101(const void *key);
+unsigned int hash_string_fnv1a(const void *key);
+unsigned int hash_string_xx(const void *key);
+unsigned int hash_string_wy(const void *key);
+// 64-bit wyhash-style hash of arbitrary bytes, for sketches and such
+uint64_t hash_bytes_wy64(const void *key, size_t length);
+
+const hash_function_descriptor *hash_functions_get_all(size_t *count);
+hash_table_hash_fn hash_functions_get_by_name(const char *name);
+
+#endif
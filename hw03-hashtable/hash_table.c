@@ -1,214 +1,1372 @@
+#define _POSIX_C_SOURCE 200809L
+
 #include "hash_table.h"
+#include "arena.h"
+#include <fcntl.h>
 #include <malloc.h>
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <strings.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 #define LOAD_FACTOR 0.5f
 #define MULTIPLIER 2
 #define LINEAR_STEP 1
+#define MAX_PROBE_LENGTH 64
+/*
+ * A long probe sequence only grows a table at least this full. In an emptier
+ * table it comes from keys sharing a hash, which no table size separates.
+ */
+#define MIN_PROBE_GROWTH_LOAD 0.125f
+#define MIGRATION_STEP 16
+#define MIN_TABLE_SIZE 8
+#define FIBONACCI_MULTIPLIER 2654435769u
+#define MAX_BUILD_THREADS 64
+#define MIN_BUILD_PARTITION_SIZE 4096
+
+#define SLOT_EMPTY 0
+#define SLOT_USED 1
+#define SLOT_DELETED 2
+
+#define INLINE_KEY_SIZE 16
+#define INLINE_KEY_WORDS (INLINE_KEY_SIZE / sizeof(uint64_t))
+#define LONG_KEY UINT8_MAX
+
+#define SNAPSHOT_MAGIC "HTSNAP03"
+#define SNAPSHOT_MAGIC_SIZE 8
+#define SNAPSHOT_POOL_ALIGNMENT 16
+
+#define CACHE_LINE_SIZE 64
+
+/*
+ * Slots are stored inline in a single array: no per-entry node allocation and
+ * the cached hash lets probing skip key_equals_function on mismatch. With
+ * HASH_TABLE_INLINE_KEYS a short key is kept zero-padded in inline_key and
+ * key_length is its length, a long key has key_length LONG_KEY. Such a slot
+ * takes 32 bytes and slot arrays are cache line aligned, so slots never
+ * straddle cache lines. Other tables never touch inline_key and store only
+ * the first LONG_KEY_SLOT_SIZE bytes of a slot, so their arrays are laid out
+ * with that stride and copied with slot_size, never by assignment.
+ */
+typedef struct {
+  unsigned int hash;
+  unsigned char state;
+  unsigned char key_length;
+  void *value;
+  union {
+    void *key;
+    uint64_t inline_key[INLINE_KEY_WORDS];
+  };
+} hash_table_slot;
+
+#define LONG_KEY_SLOT_SIZE (offsetof(hash_table_slot, key) + sizeof(void *))
+
+// The key of the current operation, prepared once for all probed slots
+typedef struct {
+  const void *key;
+  size_t length;
+  uint64_t inline_key[INLINE_KEY_WORDS];
+} probe_key;
 
 struct hash_table {
-  hash_table_entry **entries;
+  hash_table_slot *slots;
+  // Stride of slot arrays: sizeof(hash_table_slot) or LONG_KEY_SLOT_SIZE
+  size_t slot_size;
   size_t allocated_size;
+  hash_table_slot *old_slots;
+  size_t old_allocated_size;
+  size_t migrate_index;
   size_t size;
+  size_t deleted;
   hash_table_hash_fn hash_function;
   hash_table_key_equals_fn key_equals_function;
+  unsigned int flags;
+  size_t value_size;
+  arena *arena;
 };
 
-hash_table_entry deleted_entry;
+// Zeroed like calloc, but cache line aligned; released with free
+static hash_table_slot *alloc_slots(const hash_table *table, size_t count) {
+  if (count > SIZE_MAX / table->slot_size) {
+    return NULL;
+  }
+  // count is a power of two of at least MIN_TABLE_SIZE, so the size is a
+  // multiple of a line
+  hash_table_slot *slots =
+      aligned_alloc(CACHE_LINE_SIZE, count * table->slot_size);
+  if (slots != NULL) {
+    memset(slots, 0, count * table->slot_size);
+  }
+  return slots;
+}
+
+static hash_table_slot *slot_at(const hash_table *table,
+                                hash_table_slot *slots, size_t index) {
+  return (hash_table_slot *)((char *)slots + index * table->slot_size);
+}
+
+static void store_slot(const hash_table *table, hash_table_slot *slot,
+                       const hash_table_slot *entry) {
+  memcpy(slot, entry, table->slot_size);
+}
+
+static hash_table_slot load_slot(const hash_table *table,
+                                 const hash_table_slot *slot) {
+  hash_table_slot entry;
+  memcpy(&entry, slot, table->slot_size);
+  return entry;
+}
 
 hash_table *hash_table_init(hash_table_hash_fn hash_function,
                             hash_table_key_equals_fn key_equals_function,
                             size_t initial_size) {
+  return hash_table_init_ex(hash_function, key_equals_function, initial_size,
+                            0, 0);
+}
+
+hash_table *hash_table_init_ex(hash_table_hash_fn hash_function,
+                               hash_table_key_equals_fn key_equals_function,
+                               size_t initial_size, unsigned int flags,
+                               size_t value_size) {
   if (initial_size == 0) {
     return NULL;
   }
+  if ((flags & HASH_TABLE_ARENA) && value_size == 0) {
+    return NULL;
+  }
   hash_table *created_table = malloc(sizeof(hash_table));
   if (created_table == NULL)
     return NULL;
+  size_t allocated_size = MIN_TABLE_SIZE;
+  while (allocated_size < initial_size) {
+    allocated_size <<= 1;
+  }
   created_table->size = 0;
-  created_table->allocated_size = initial_size;
-  hash_table_entry **entry_array =
-      malloc(sizeof(hash_table_entry *) * initial_size);
-  if (entry_array == NULL) {
+  created_table->deleted = 0;
+  created_table->allocated_size = allocated_size;
+  created_table->slot_size = (flags & HASH_TABLE_INLINE_KEYS)
+                                 ? sizeof(hash_table_slot)
+                                 : LONG_KEY_SLOT_SIZE;
+  hash_table_slot *slot_array = alloc_slots(created_table, allocated_size);
+  if (slot_array == NULL) {
     free(created_table);
     return NULL;
   }
-  memset(entry_array, 0,
-         sizeof(hash_table_entry *) * created_table->allocated_size);
-  created_table->entries = entry_array;
+  created_table->slots = slot_array;
+  created_table->old_slots = NULL;
+  created_table->old_allocated_size = 0;
+  created_table->migrate_index = 0;
   created_table->hash_function = hash_function;
   created_table->key_equals_function = key_equals_function;
+  created_table->flags = flags;
+  created_table->value_size = value_size;
+  created_table->arena = NULL;
+  if (flags & HASH_TABLE_ARENA) {
+    created_table->arena = arena_init(ARENA_DEFAULT_SLAB_SIZE);
+    if (created_table->arena == NULL) {
+      free(slot_array);
+      free(created_table);
+      return NULL;
+    }
+  }
   return created_table;
 }
 
-int probe_add(hash_table *table, const void *key) {
-  unsigned int hash = table->hash_function(key);
-  size_t index = hash % table->allocated_size;
+static void init_probe_key(const hash_table *table, const void *key,
+                           probe_key *probe) {
+  probe->key = key;
+  if (!(table->flags & HASH_TABLE_INLINE_KEYS)) {
+    return;
+  }
+  probe->length = strlen(key);
+  memset(probe->inline_key, 0, INLINE_KEY_SIZE);
+  if (probe->length < INLINE_KEY_SIZE) {
+    memcpy(probe->inline_key, key, probe->length);
+  }
+}
+
+static bool is_inline_key(const hash_table *table,
+                          const hash_table_slot *slot) {
+  return (table->flags & HASH_TABLE_INLINE_KEYS) &&
+         slot->key_length != LONG_KEY;
+}
+
+static void *slot_key(const hash_table *table, hash_table_slot *slot) {
+  return is_inline_key(table, slot) ? (void *)slot->inline_key : slot->key;
+}
+
+static bool slot_matches(hash_table *table, const hash_table_slot *slot,
+                         unsigned int hash, const probe_key *probe) {
+  if (slot->hash != hash) {
+    return false;
+  }
+  if (!(table->flags & HASH_TABLE_INLINE_KEYS)) {
+    return table->key_equals_function(slot->key, probe->key);
+  }
+  if (probe->length >= INLINE_KEY_SIZE) {
+    return slot->key_length == LONG_KEY && strcmp(slot->key, probe->key) == 0;
+  }
+  bool equal = slot->key_length == probe->length;
+  for (size_t i = 0; i < INLINE_KEY_WORDS; i++) {
+    equal &= slot->inline_key[i] == probe->inline_key[i];
+  }
+  return equal;
+}
+
+/*
+ * Table sizes are powers of two. The hash is mixed by Fibonacci hashing and
+ * its top bits are taken as the index (fastrange), so hash functions with
+ * weak low bits do not cluster, and no division is needed.
+ */
+static size_t slot_index(unsigned int hash, size_t allocated_size) {
+  uint32_t mixed = (uint32_t)hash * FIBONACCI_MULTIPLIER;
+  return ((uint64_t)mixed * allocated_size) >> 32;
+}
+
+static size_t home_index(const hash_table *table, unsigned int hash) {
+  return slot_index(hash, table->allocated_size);
+}
+
+static size_t next_index(const hash_table *table, size_t index) {
+  return (index + LINEAR_STEP) & (table->allocated_size - 1);
+}
+
+static size_t probe_distance(const hash_table *table, size_t index,
+                             unsigned int hash) {
+  return (index - home_index(table, hash)) & (table->allocated_size - 1);
+}
+
+static int probe_add(hash_table *table, const probe_key *probe,
+                     unsigned int hash) {
+  size_t index = home_index(table, hash);
   size_t iteration_count = 0;
-  while (table->entries[index] != NULL &&
-         (table->entries[index] != &deleted_entry) &&
-         !table->key_equals_function(table->entries[index]->key, key)) {
-    index += LINEAR_STEP;
-    if (index >= table->allocated_size) {
-      index = 0;
+  int first_deleted = -1;
+  hash_table_slot *slot;
+  while ((slot = slot_at(table, table->slots, index))->state != SLOT_EMPTY) {
+    if (slot->state == SLOT_DELETED) {
+      if (first_deleted < 0) {
+        first_deleted = index;
+      }
+    } else if (slot_matches(table, slot, hash, probe)) {
+      return index;
     }
+    index = next_index(table, index);
     if (++iteration_count > table->allocated_size) {
+      if (first_deleted >= 0) {
+        return first_deleted;
+      }
       return -3; // bad hashtable config - no free entries or bad search
                  // algorithm;
     }
   }
+  return first_deleted >= 0 ? first_deleted : (int)index;
+}
+
+/*
+ * Robin Hood probing: a slot whose entry sits closer to its home than the
+ * probed key would be never precedes the key in its chain, so the search
+ * stops there. The returned index is either the matching slot (*found is set)
+ * or the slot where the key has to be inserted.
+ */
+static int probe_robin_hood(hash_table *table, const probe_key *probe,
+                            unsigned int hash, bool *found) {
+  size_t index = home_index(table, hash);
+  size_t distance = 0;
+  hash_table_slot *slot;
+  while ((slot = slot_at(table, table->slots, index))->state == SLOT_USED) {
+    if (probe_distance(table, index, slot->hash) < distance) {
+      break;
+    }
+    if (slot_matches(table, slot, hash, probe)) {
+      *found = true;
+      return index;
+    }
+    index = next_index(table, index);
+    distance++;
+  }
+  *found = false;
   return index;
 }
 
-int probe_get(hash_table *table, const void *key) {
-  unsigned int hash = table->hash_function(key);
-  size_t index = hash % table->allocated_size;
-  while (table->entries[index] != NULL) {
-    if (table->entries[index] == &deleted_entry ||
-        !table->key_equals_function(table->entries[index]->key, key)) {
-      index++;
-      if (index >= table->allocated_size) {
-        index = 0;
-      }
-    } else {
+static int probe_get(hash_table *table, const probe_key *probe,
+                     unsigned int hash) {
+  if (table->flags & HASH_TABLE_ROBIN_HOOD) {
+    bool found;
+    int index = probe_robin_hood(table, probe, hash, &found);
+    return found ? index : -1;
+  }
+  size_t index = home_index(table, hash);
+  size_t iteration_count = 0;
+  hash_table_slot *slot;
+  while ((slot = slot_at(table, table->slots, index))->state != SLOT_EMPTY) {
+    if (slot->state == SLOT_USED && slot_matches(table, slot, hash, probe)) {
       return index;
     }
+    index = next_index(table, index);
+    if (++iteration_count >= table->allocated_size) {
+      break;
+    }
   }
   return -1;
 }
 
-int recalc_table(hash_table *table) {
-  size_t new_allocation_size = table->allocated_size * MULTIPLIER;
+/*
+ * Places the entry at index, displacing entries that are closer to their home
+ * further down the chain. Returns the longest probe distance produced.
+ */
+static size_t robin_hood_place(hash_table *table, size_t index,
+                               hash_table_slot entry) {
+  size_t distance = probe_distance(table, index, entry.hash);
+  size_t max_distance = distance;
+  hash_table_slot *slot;
+  while ((slot = slot_at(table, table->slots, index))->state == SLOT_USED) {
+    size_t slot_distance = probe_distance(table, index, slot->hash);
+    if (slot_distance < distance) {
+      hash_table_slot displaced = load_slot(table, slot);
+      store_slot(table, slot, &entry);
+      entry = displaced;
+      distance = slot_distance;
+    }
+    index = next_index(table, index);
+    distance++;
+    if (distance > max_distance) {
+      max_distance = distance;
+    }
+  }
+  store_slot(table, slot, &entry);
+  return max_distance;
+}
+
+static void place_entry(hash_table *table, hash_table_slot entry) {
+  size_t index = home_index(table, entry.hash);
+  if (table->flags & HASH_TABLE_ROBIN_HOOD) {
+    robin_hood_place(table, index, entry);
+    return;
+  }
+  while (slot_at(table, table->slots, index)->state != SLOT_EMPTY) {
+    index = next_index(table, index);
+  }
+  store_slot(table, slot_at(table, table->slots, index), &entry);
+}
+
+static int recalc_table(hash_table *table, size_t new_allocation_size) {
+  hash_table_slot *old_slots = table->slots;
   size_t old_allocation_size = table->allocated_size;
-  hash_table_entry **old_entries = table->entries;
-  hash_table_entry **new_entries =
-      malloc(sizeof(hash_table_entry *) * new_allocation_size);
-  if (new_entries == NULL) {
+  hash_table_slot *new_slots = alloc_slots(table, new_allocation_size);
+  if (new_slots == NULL) {
     return 2;
   }
-  memset(new_entries, 0, sizeof(hash_table_entry *) * new_allocation_size);
-  table->entries = new_entries;
+  table->slots = new_slots;
   table->allocated_size = new_allocation_size;
   for (size_t idx = 0; idx < old_allocation_size; idx++) {
-    if (old_entries[idx] == NULL || old_entries[idx] == &deleted_entry) {
+    hash_table_slot *slot = slot_at(table, old_slots, idx);
+    if (slot->state != SLOT_USED) {
       continue;
     }
-    int founded_index = probe_add(table, old_entries[idx]->key);
-    if (founded_index < 0) {
-      table->entries = old_entries;
-      table->allocated_size = old_allocation_size;
-      free(new_entries);
-      return 3;
+    place_entry(table, load_slot(table, slot));
+  }
+  table->deleted = 0;
+  free(old_slots);
+  return 0;
+}
+
+/*
+ * Incremental rehash: the previous slot array is kept while its entries are
+ * moved to the new one MIGRATION_STEP slots per operation. Migrated slots are
+ * turned into tombstones so that probe chains in the old array stay intact.
+ */
+static void migrate_step(hash_table *table, size_t slot_count) {
+  if (table->old_slots == NULL) {
+    return;
+  }
+  size_t end = table->migrate_index + slot_count;
+  if (end > table->old_allocated_size) {
+    end = table->old_allocated_size;
+  }
+  for (size_t idx = table->migrate_index; idx < end; idx++) {
+    hash_table_slot *slot = slot_at(table, table->old_slots, idx);
+    if (slot->state != SLOT_USED) {
+      continue;
     }
-    table->entries[founded_index] = old_entries[idx];
+    place_entry(table, load_slot(table, slot));
+    slot->state = SLOT_DELETED;
   }
-  free(old_entries);
+  table->migrate_index = end;
+  if (end == table->old_allocated_size) {
+    free(table->old_slots);
+    table->old_slots = NULL;
+    table->old_allocated_size = 0;
+    table->migrate_index = 0;
+  }
+}
+
+static int start_migration(hash_table *table, size_t new_allocation_size) {
+  migrate_step(table, table->old_allocated_size);
+  hash_table_slot *new_slots = alloc_slots(table, new_allocation_size);
+  if (new_slots == NULL) {
+    return 2;
+  }
+  table->old_slots = table->slots;
+  table->old_allocated_size = table->allocated_size;
+  table->migrate_index = 0;
+  table->slots = new_slots;
+  table->allocated_size = new_allocation_size;
+  table->deleted = 0;
   return 0;
 }
 
+static int probe_old(hash_table *table, const probe_key *probe,
+                     unsigned int hash) {
+  if (table->old_slots == NULL) {
+    return -1;
+  }
+  size_t index = slot_index(hash, table->old_allocated_size);
+  hash_table_slot *slot;
+  while ((slot = slot_at(table, table->old_slots, index))->state !=
+         SLOT_EMPTY) {
+    if (slot->state == SLOT_USED && slot_matches(table, slot, hash, probe)) {
+      return index;
+    }
+    index = (index + LINEAR_STEP) & (table->old_allocated_size - 1);
+  }
+  return -1;
+}
+
+static int resize_table(hash_table *table, size_t new_allocation_size) {
+  if (table->flags & HASH_TABLE_INCREMENTAL_REHASH) {
+    return start_migration(table, new_allocation_size);
+  }
+  return recalc_table(table, new_allocation_size);
+}
+
+// The smallest slot array size holding entry_count entries below the load
+// factor
+static size_t capacity_for(size_t entry_count) {
+  size_t allocated_size = MIN_TABLE_SIZE;
+  while (entry_count >= allocated_size * LOAD_FACTOR) {
+    allocated_size <<= 1;
+  }
+  return allocated_size;
+}
+
+static int grow_if_needed(hash_table *table, size_t probe_length) {
+  size_t used = table->size + table->deleted;
+  bool long_probe = probe_length > MAX_PROBE_LENGTH &&
+                    used >= table->allocated_size * MIN_PROBE_GROWTH_LOAD;
+  if (used < table->allocated_size * LOAD_FACTOR && !long_probe) {
+    return 0;
+  }
+  // Mostly tombstones: clean them up without growing the table.
+  if (table->deleted > table->size && !long_probe) {
+    return resize_table(table, table->allocated_size);
+  }
+  return resize_table(table, table->allocated_size * MULTIPLIER);
+}
+
+static void *copy_data(arena *arena, const void *data, size_t size,
+                       size_t alignment) {
+  void *copy = arena != NULL ? arena_alloc(arena, size, alignment) : malloc(size);
+  if (copy == NULL) {
+    return NULL;
+  }
+  memcpy(copy, data, size);
+  return copy;
+}
+
+static void release_data(hash_table *table, void *data) {
+  if (table->arena == NULL) {
+    free(data);
+  }
+}
+
+static size_t value_alignment(size_t value_size) {
+  size_t alignment = 1;
+  while (alignment < value_size && alignment < _Alignof(max_align_t)) {
+    alignment <<= 1;
+  }
+  return alignment;
+}
+
+/*
+ * Finds the slot holding the key or the slot where it has to be inserted.
+ * Returns a negative code when no slot can be found.
+ */
+static int probe_for_insert(hash_table *table, const probe_key *probe,
+                            unsigned int hash, bool *found) {
+  migrate_step(table, MIGRATION_STEP);
+  int old_index = probe_old(table, probe, hash);
+  if (old_index >= 0) {
+    hash_table_slot *old_slot = slot_at(table, table->old_slots, old_index);
+    place_entry(table, load_slot(table, old_slot));
+    old_slot->state = SLOT_DELETED;
+  }
+  if (table->flags & HASH_TABLE_ROBIN_HOOD) {
+    return probe_robin_hood(table, probe, hash, found);
+  }
+  int index = probe_add(table, probe, hash);
+  *found =
+      index >= 0 && slot_at(table, table->slots, index)->state == SLOT_USED;
+  return index;
+}
+
+// Puts the key into the entry: inline when it fits, otherwise as a copy
+static bool store_key(hash_table *table, arena *arena, hash_table_slot *entry,
+                      const probe_key *probe, size_t key_size) {
+  if ((table->flags & HASH_TABLE_INLINE_KEYS) &&
+      probe->length < INLINE_KEY_SIZE) {
+    entry->key_length = probe->length;
+    memcpy(entry->inline_key, probe->inline_key, INLINE_KEY_SIZE);
+    return true;
+  }
+  entry->key_length = LONG_KEY;
+  entry->key = copy_data(arena, probe->key, key_size, 1);
+  return entry->key != NULL;
+}
+
+static void release_key(hash_table *table, hash_table_slot *slot) {
+  if (!is_inline_key(table, slot)) {
+    release_data(table, slot->key);
+  }
+}
+
+/*
+ * The entry is stored even if growing the table fails: the table is then just
+ * fuller than the load factor and the next insertion tries to grow it again.
+ */
+static void insert_at(hash_table *table, size_t index, hash_table_slot entry) {
+  size_t probe_length = 0;
+  if (table->flags & HASH_TABLE_ROBIN_HOOD) {
+    probe_length = robin_hood_place(table, index, entry);
+  } else {
+    hash_table_slot *slot = slot_at(table, table->slots, index);
+    if (slot->state == SLOT_DELETED) {
+      table->deleted--;
+    }
+    store_slot(table, slot, &entry);
+  }
+  table->size++;
+  grow_if_needed(table, probe_length);
+}
+
 int hash_table_put(hash_table *table, const void *key, size_t key_size,
                    const void *value, size_t value_size, void **prev_value) {
-  int index = probe_add(table, key);
+  return hash_table_put_hashed(table, key, table->hash_function(key), key_size,
+                               value, value_size, prev_value);
+}
+
+int hash_table_put_hashed(hash_table *table, const void *key,
+                          unsigned int hash, size_t key_size,
+                          const void *value, size_t value_size,
+                          void **prev_value) {
+  if (table->arena != NULL && value_size != table->value_size) {
+    return -2;
+  }
+  probe_key probe;
+  init_probe_key(table, key, &probe);
+  bool found = false;
+  int index = probe_for_insert(table, &probe, hash, &found);
   if (index < 0) {
     return index;
   }
-  void *value_copy = malloc(value_size);
+  hash_table_slot *slot = slot_at(table, table->slots, index);
+  if (found && prev_value == NULL && table->arena != NULL) {
+    memcpy(slot->value, value, value_size);
+    return 0;
+  }
+  void *value_copy = copy_data(table->arena, value, value_size,
+                               value_alignment(value_size));
   if (value_copy == NULL) {
     return -1;
   }
-  memcpy(value_copy, value, value_size);
-  hash_table_entry *prev_entry = table->entries[index];
-  if (prev_entry == NULL || prev_entry == &deleted_entry) {
-      void *key_copy = malloc(key_size);
-    if (key_copy == NULL) {
-      free(value_copy);
-      return -1;
-    }
-    memcpy(key_copy, key, key_size);
-    hash_table_entry *entry = malloc(sizeof(hash_table_entry));
-    if (entry == NULL) {
-      free(key_copy);
-      free(value_copy);
-      return -1;
-    }
-    entry->key = key_copy;
-    entry->value = value_copy;
-    table->entries[index] = entry;
-    table->size++;
-    if (prev_value != NULL) {
-      *prev_value = NULL;
-    }
-    if (table->size >= table->allocated_size * LOAD_FACTOR) {
-      int recal_ret_val = recalc_table(table);
-      if (recal_ret_val != 0) {
-        return recal_ret_val;
-      }
-    }
-  } else {
+  if (found) {
     if (prev_value != NULL) {
-      *prev_value = prev_entry->value;
+      *prev_value = slot->value;
     } else {
-      free(prev_entry->value);
+      release_data(table, slot->value);
     }
-    prev_entry->value = value_copy;
+    slot->value = value_copy;
+    return 0;
+  }
+  hash_table_slot entry = {
+      .hash = hash, .state = SLOT_USED, .value = value_copy};
+  if (!store_key(table, table->arena, &entry, &probe, key_size)) {
+    release_data(table, value_copy);
+    return -1;
+  }
+  if (prev_value != NULL) {
+    *prev_value = NULL;
   }
+  insert_at(table, index, entry);
   return 0;
 }
 
-void *hash_table_get(hash_table *table, const void *key) {
-  int index = probe_get(table, key);
+void *hash_table_get_or_insert(hash_table *table, const void *key,
+                               size_t key_size, const void *initial_value,
+                               size_t value_size, bool *inserted) {
+  return hash_table_get_or_insert_hashed(table, key, table->hash_function(key),
+                                         key_size, initial_value, value_size,
+                                         inserted);
+}
+
+void *hash_table_get_or_insert_hashed(hash_table *table, const void *key,
+                                      unsigned int hash, size_t key_size,
+                                      const void *initial_value,
+                                      size_t value_size, bool *inserted) {
+  if (inserted != NULL) {
+    *inserted = false;
+  }
+  if (table->arena != NULL && value_size != table->value_size) {
+    return NULL;
+  }
+  probe_key probe;
+  init_probe_key(table, key, &probe);
+  bool found = false;
+  int index = probe_for_insert(table, &probe, hash, &found);
   if (index < 0) {
     return NULL;
   }
-  return table->entries[index]->value;
+  if (found) {
+    return slot_at(table, table->slots, index)->value;
+  }
+  void *value_copy = copy_data(table->arena, initial_value, value_size,
+                               value_alignment(value_size));
+  if (value_copy == NULL) {
+    return NULL;
+  }
+  hash_table_slot entry = {
+      .hash = hash, .state = SLOT_USED, .value = value_copy};
+  if (!store_key(table, table->arena, &entry, &probe, key_size)) {
+    release_data(table, value_copy);
+    return NULL;
+  }
+  insert_at(table, index, entry);
+  if (inserted != NULL) {
+    *inserted = true;
+  }
+  return value_copy;
+}
+
+void *hash_table_get(hash_table *table, const void *key) {
+  return hash_table_get_hashed(table, key, table->hash_function(key));
+}
+
+void *hash_table_get_hashed(hash_table *table, const void *key,
+                            unsigned int hash) {
+  migrate_step(table, MIGRATION_STEP);
+  probe_key probe;
+  init_probe_key(table, key, &probe);
+  int index = probe_get(table, &probe, hash);
+  if (index >= 0) {
+    return slot_at(table, table->slots, index)->value;
+  }
+  index = probe_old(table, &probe, hash);
+  if (index >= 0) {
+    return slot_at(table, table->old_slots, index)->value;
+  }
+  return NULL;
+}
+
+static void free_slot_data(hash_table *table, hash_table_slot *slots,
+                           size_t allocated_size) {
+  for (size_t i = 0; i < allocated_size; i++) {
+    hash_table_slot *slot = slot_at(table, slots, i);
+    if (slot->state != SLOT_USED) {
+      continue;
+    }
+    release_key(table, slot);
+    free(slot->value);
+  }
 }
 
 void hash_table_free(hash_table *table) {
   if (table == NULL) {
     return;
   }
-  if (table->entries == NULL) {
+  if (table->slots == NULL) {
     free(table);
     return;
   }
-  for (size_t i = 0; i < table->allocated_size; i++) {
-    hash_table_entry *entry = table->entries[i];
-    if (entry == NULL || entry == &deleted_entry) {
-      continue;
+  if (table->arena != NULL) {
+    arena_free(table->arena);
+  } else {
+    free_slot_data(table, table->slots, table->allocated_size);
+    if (table->old_slots != NULL) {
+      free_slot_data(table, table->old_slots,
+                     table->old_allocated_size);
     }
-    free(entry->key);
-    free(entry->value);
-    free(entry);
   }
-  free(table->entries);
+  free(table->old_slots);
+  free(table->slots);
   free(table);
 }
 
 size_t hash_table_get_size(hash_table *table) { return table->size; }
 
+// Iterates over the used slots of both slot arrays, *cursor starts at 0
+static hash_table_slot *next_used_slot(hash_table *table, size_t *cursor) {
+  while (*cursor < table->old_allocated_size + table->allocated_size) {
+    size_t idx = (*cursor)++;
+    size_t old_size = table->old_allocated_size;
+    hash_table_slot *slot = idx < old_size
+                                ? slot_at(table, table->old_slots, idx)
+                                : slot_at(table, table->slots, idx - old_size);
+    if (slot->state == SLOT_USED) {
+      return slot;
+    }
+  }
+  return NULL;
+}
+
+void hash_table_iterator_init(hash_table *table,
+                              hash_table_iterator *iterator) {
+  // Slots of the old array before migrate_index have already been moved
+  iterator->position = table->migrate_index;
+}
+
+bool hash_table_iterator_next(hash_table *table, hash_table_iterator *iterator,
+                              hash_table_entry *entry) {
+  hash_table_slot *slot = next_used_slot(table, &iterator->position);
+  if (slot == NULL) {
+    return false;
+  }
+  entry->key = slot_key(table, slot);
+  entry->value = slot->value;
+  return true;
+}
+
+size_t hash_table_iterator_next_batch(hash_table *table,
+                                      hash_table_iterator *iterator,
+                                      hash_table_entry *entries,
+                                      size_t max_count) {
+  size_t count = 0;
+  hash_table_slot *slot;
+  while (count < max_count &&
+         (slot = next_used_slot(table, &iterator->position)) != NULL) {
+    entries[count].key = slot_key(table, slot);
+    entries[count].value = slot->value;
+    count++;
+  }
+  return count;
+}
+
 size_t hash_table_for_each_entry(hash_table *table,
                                  table_entry_consumer_fn consumer_function) {
   size_t counter = 0;
-  for (size_t idx = 0; idx < table->allocated_size; idx++) {
-    if (table->entries[idx] == NULL || table->entries[idx] == &deleted_entry) {
-      continue;
-    }
-    consumer_function(table->entries[idx]->key, table->entries[idx]->value);
+  hash_table_iterator iterator;
+  hash_table_entry entry;
+  hash_table_iterator_init(table, &iterator);
+  while (hash_table_iterator_next(table, &iterator, &entry)) {
+    consumer_function(entry.key, entry.value);
     counter++;
   }
   return counter;
 }
 
 bool hash_table_delete(hash_table *table, const void *key) {
-  int index = probe_get(table, key);
+  return hash_table_delete_hashed(table, key, table->hash_function(key));
+}
+
+bool hash_table_delete_hashed(hash_table *table, const void *key,
+                              unsigned int hash) {
+  migrate_step(table, MIGRATION_STEP);
+  probe_key probe;
+  init_probe_key(table, key, &probe);
+  int index = probe_get(table, &probe, hash);
   if (index < 0) {
-    return false;
+    index = probe_old(table, &probe, hash);
+    if (index < 0) {
+      return false;
+    }
+    hash_table_slot *old_slot = slot_at(table, table->old_slots, index);
+    release_key(table, old_slot);
+    release_data(table, old_slot->value);
+    old_slot->state = SLOT_DELETED;
+    table->size--;
+    return true;
   }
-  free(table->entries[index]->key);
-  free(table->entries[index]->value);
-  free(table->entries[index]);
-  table->entries[index] = &deleted_entry;
+  hash_table_slot *slot = slot_at(table, table->slots, index);
+  release_key(table, slot);
+  release_data(table, slot->value);
   table->size--;
+  if (!(table->flags & HASH_TABLE_ROBIN_HOOD)) {
+    slot->key = NULL;
+    slot->value = NULL;
+    slot->state = SLOT_DELETED;
+    table->deleted++;
+    return true;
+  }
+  // Backward-shift deletion: pull the rest of the chain one slot closer to
+  // home instead of leaving a tombstone.
+  hash_table_slot *hole = slot;
+  size_t next = next_index(table, index);
+  hash_table_slot *next_slot;
+  while ((next_slot = slot_at(table, table->slots, next))->state ==
+             SLOT_USED &&
+         probe_distance(table, next, next_slot->hash) > 0) {
+    memcpy(hole, next_slot, table->slot_size);
+    hole = next_slot;
+    next = next_index(table, next);
+  }
+  memset(hole, 0, table->slot_size);
+  return true;
+}
+
+static void add_probe_length(hash_table_stats *stats, size_t distance) {
+  stats->average_probe_length += distance;
+  if (distance > stats->max_probe_length) {
+    stats->max_probe_length = distance;
+  }
+  if (distance >= HASH_TABLE_STATS_HISTOGRAM_SIZE) {
+    distance = HASH_TABLE_STATS_HISTOGRAM_SIZE - 1;
+  }
+  stats->probe_length_histogram[distance]++;
+}
+
+void hash_table_get_stats(hash_table *table, hash_table_stats *stats) {
+  memset(stats, 0, sizeof(hash_table_stats));
+  stats->size = table->size;
+  stats->allocated_size = table->allocated_size + table->old_allocated_size;
+  stats->deleted = table->deleted;
+  for (size_t idx = 0; idx < table->allocated_size; idx++) {
+    hash_table_slot *slot = slot_at(table, table->slots, idx);
+    if (slot->state == SLOT_USED) {
+      add_probe_length(stats, probe_distance(table, idx, slot->hash));
+    }
+  }
+  size_t old_mask = table->old_allocated_size - 1;
+  for (size_t idx = table->migrate_index; idx < table->old_allocated_size;
+       idx++) {
+    hash_table_slot *slot = slot_at(table, table->old_slots, idx);
+    if (slot->state == SLOT_USED) {
+      size_t home = slot_index(slot->hash, table->old_allocated_size);
+      add_probe_length(stats, (idx - home) & old_mask);
+    }
+  }
+  if (table->size > 0) {
+    stats->average_probe_length /= table->size;
+  }
+}
+
+int hash_table_reserve(hash_table *table, size_t entry_count) {
+  size_t allocated_size = capacity_for(entry_count);
+  if (allocated_size <= table->allocated_size) {
+    return 0;
+  }
+  migrate_step(table, table->old_allocated_size);
+  return recalc_table(table, allocated_size);
+}
+
+/*
+ * Bulk build: the slot array is split into ranges [begin, end), one per task.
+ * A task places the keys whose home slot is in its range without ever crossing
+ * the end of the range, so tasks never touch the same slots. Entries pushed
+ * past the end are kept in overflow and placed at the end of the build.
+ *
+ * Key indices are first bucketed by range with a counting sort: each task
+ * counts the ranges of its share of the keys while hashing them, then writes
+ * their indices into order at offsets derived from all the counts. A range
+ * task then reads only its own bucket order[order_begin, order_end).
+ */
+typedef struct {
+  hash_table *table;
+  const void *const *keys;
+  const size_t *key_sizes;
+  const unsigned char *values;
+  unsigned int *hashes;
+  size_t *order;
+  size_t range_count;
+  size_t first_key;
+  size_t last_key;
+  // Keys of this task's share in each range, then where the next one goes
+  size_t range_offsets[MAX_BUILD_THREADS];
+  size_t order_begin;
+  size_t order_end;
+  size_t begin;
+  size_t end;
+  arena *arena;
+  hash_table_slot *overflow;
+  size_t overflow_count;
+  size_t overflow_capacity;
+  int result;
+} build_task;
+
+// Overflow entries are laid out like slot arrays, with the table's stride
+static bool add_overflow(build_task *task, hash_table_slot entry) {
+  const hash_table *table = task->table;
+  if (task->overflow_count == task->overflow_capacity) {
+    size_t capacity =
+        task->overflow_capacity > 0 ? task->overflow_capacity * 2 : 64;
+    hash_table_slot *overflow =
+        realloc(task->overflow, capacity * table->slot_size);
+    if (overflow == NULL) {
+      return false;
+    }
+    task->overflow = overflow;
+    task->overflow_capacity = capacity;
+  }
+  store_slot(table, slot_at(table, task->overflow, task->overflow_count++),
+             &entry);
+  return true;
+}
+
+/*
+ * Places the entry like place_entry, but stops at end: the entry left without
+ * a slot (for Robin Hood possibly a displaced one) is returned in *rest.
+ */
+static bool place_in_range(hash_table *table, hash_table_slot entry,
+                           size_t end, hash_table_slot *rest) {
+  size_t index = home_index(table, entry.hash);
+  size_t distance = 0;
+  bool robin_hood = table->flags & HASH_TABLE_ROBIN_HOOD;
+  while (index < end &&
+         slot_at(table, table->slots, index)->state == SLOT_USED) {
+    hash_table_slot *slot = slot_at(table, table->slots, index);
+    if (robin_hood) {
+      size_t slot_distance = index - home_index(table, slot->hash);
+      if (slot_distance < distance) {
+        hash_table_slot displaced = load_slot(table, slot);
+        store_slot(table, slot, &entry);
+        entry = displaced;
+        distance = slot_distance;
+      }
+    }
+    index++;
+    distance++;
+  }
+  if (index == end) {
+    *rest = entry;
+    return false;
+  }
+  store_slot(table, slot_at(table, table->slots, index), &entry);
   return true;
 }
+
+// Range i starts at the first slot s with s * range_count / size >= i
+static size_t range_begin(size_t allocated_size, size_t range_count,
+                          size_t range) {
+  return (allocated_size * range + range_count - 1) / range_count;
+}
+
+static size_t range_of(const hash_table *table, size_t range_count,
+                       unsigned int hash) {
+  return home_index(table, hash) * range_count / table->allocated_size;
+}
+
+static void *hash_build_keys(void *arg) {
+  build_task *task = arg;
+  for (size_t i = task->first_key; i < task->last_key; i++) {
+    task->hashes[i] = task->table->hash_function(task->keys[i]);
+    task->range_offsets[range_of(task->table, task->range_count,
+                                 task->hashes[i])]++;
+  }
+  return NULL;
+}
+
+static void *bucket_keys(void *arg) {
+  build_task *task = arg;
+  for (size_t i = task->first_key; i < task->last_key; i++) {
+    size_t range = range_of(task->table, task->range_count, task->hashes[i]);
+    task->order[task->range_offsets[range]++] = i;
+  }
+  return NULL;
+}
+
+static void *build_range(void *arg) {
+  build_task *task = arg;
+  hash_table *table = task->table;
+  size_t value_size = table->value_size;
+  size_t alignment = value_alignment(value_size);
+  for (size_t j = task->order_begin; j < task->order_end; j++) {
+    size_t i = task->order[j];
+    hash_table_slot entry = {.hash = task->hashes[i], .state = SLOT_USED};
+    entry.value = copy_data(task->arena, task->values + i * value_size,
+                            value_size, alignment);
+    probe_key probe;
+    init_probe_key(table, task->keys[i], &probe);
+    if (entry.value == NULL ||
+        !store_key(table, task->arena, &entry, &probe, task->key_sizes[i])) {
+      task->result = -1;
+      return NULL;
+    }
+    hash_table_slot rest;
+    if (!place_in_range(table, entry, task->end, &rest) &&
+        !add_overflow(task, rest)) {
+      task->result = -1;
+      return NULL;
+    }
+  }
+  return NULL;
+}
+
+// Runs the task function for every task, in parallel if there are several
+static int run_build_tasks(build_task *tasks, size_t task_count,
+                           void *(*task_function)(void *)) {
+  if (task_count == 1) {
+    task_function(&tasks[0]);
+    return 0;
+  }
+  pthread_t threads[MAX_BUILD_THREADS];
+  size_t started = 0;
+  int ret_val = 0;
+  for (; started < task_count; started++) {
+    if (pthread_create(&threads[started], NULL, task_function,
+                       &tasks[started]) != 0) {
+      ret_val = -1;
+      break;
+    }
+  }
+  for (size_t i = 0; i < started; i++) {
+    pthread_join(threads[i], NULL);
+  }
+  return ret_val;
+}
+
+hash_table *hash_table_build(hash_table_hash_fn hash_function,
+                             hash_table_key_equals_fn key_equals_function,
+                             unsigned int flags, size_t value_size,
+                             const void *const *keys, const size_t *key_sizes,
+                             const void *values, size_t count,
+                             size_t thread_count) {
+  size_t allocated_size = capacity_for(count);
+  hash_table *table = hash_table_init_ex(hash_function, key_equals_function,
+                                         allocated_size, flags, value_size);
+  unsigned int *hashes = malloc(sizeof(unsigned int) * (count > 0 ? count : 1));
+  size_t *order = malloc(sizeof(size_t) * (count > 0 ? count : 1));
+  if (table == NULL || hashes == NULL || order == NULL) {
+    hash_table_free(table);
+    free(hashes);
+    free(order);
+    return NULL;
+  }
+  size_t task_count = thread_count > 0 ? thread_count : 1;
+  if (task_count > MAX_BUILD_THREADS) {
+    task_count = MAX_BUILD_THREADS;
+  }
+  if (task_count > allocated_size / MIN_BUILD_PARTITION_SIZE) {
+    task_count = allocated_size / MIN_BUILD_PARTITION_SIZE;
+  }
+  if (task_count == 0) {
+    task_count = 1;
+  }
+  build_task tasks[MAX_BUILD_THREADS];
+  memset(tasks, 0, sizeof(build_task) * task_count);
+  int ret_val = 0;
+  for (size_t i = 0; i < task_count; i++) {
+    tasks[i].table = table;
+    tasks[i].keys = keys;
+    tasks[i].key_sizes = key_sizes;
+    tasks[i].values = values;
+    tasks[i].hashes = hashes;
+    tasks[i].order = order;
+    tasks[i].range_count = task_count;
+    tasks[i].first_key = count * i / task_count;
+    tasks[i].last_key = count * (i + 1) / task_count;
+    tasks[i].begin = range_begin(allocated_size, task_count, i);
+    tasks[i].end = range_begin(allocated_size, task_count, i + 1);
+    if (table->arena != NULL && i > 0) {
+      tasks[i].arena = arena_init(ARENA_DEFAULT_SLAB_SIZE);
+      if (tasks[i].arena == NULL) {
+        ret_val = -1;
+      }
+    } else {
+      tasks[i].arena = table->arena;
+    }
+  }
+  if (ret_val == 0) {
+    ret_val = run_build_tasks(tasks, task_count, hash_build_keys);
+  }
+  if (ret_val == 0) {
+    // Within a bucket keys keep their order: by task, then by index
+    size_t offset = 0;
+    for (size_t range = 0; range < task_count; range++) {
+      tasks[range].order_begin = offset;
+      for (size_t i = 0; i < task_count; i++) {
+        size_t range_size = tasks[i].range_offsets[range];
+        tasks[i].range_offsets[range] = offset;
+        offset += range_size;
+      }
+      tasks[range].order_end = offset;
+    }
+    ret_val = run_build_tasks(tasks, task_count, bucket_keys);
+  }
+  if (ret_val == 0) {
+    ret_val = run_build_tasks(tasks, task_count, build_range);
+  }
+  for (size_t i = 0; i < task_count; i++) {
+    if (tasks[i].result != 0) {
+      ret_val = tasks[i].result;
+    }
+    if (tasks[i].arena != NULL && tasks[i].arena != table->arena) {
+      arena_absorb(table->arena, tasks[i].arena);
+    }
+    for (size_t j = 0; ret_val == 0 && j < tasks[i].overflow_count; j++) {
+      place_entry(table,
+                  load_slot(table, slot_at(table, tasks[i].overflow, j)));
+    }
+    if (ret_val != 0 && table->arena == NULL) {
+      free_slot_data(table, tasks[i].overflow, tasks[i].overflow_count);
+    }
+    free(tasks[i].overflow);
+  }
+  free(hashes);
+  free(order);
+  if (ret_val != 0) {
+    hash_table_free(table);
+    return NULL;
+  }
+  table->size = count;
+  return table;
+}
+
+/*
+ * Snapshot file layout: the header, allocated_size slots and the pool starting
+ * at pool_offset. Each entry's value (aligned as in the table) is followed by
+ * its key; slots refer to them by offsets from the start of the file. Slots
+ * are placed by linear probing at the same load factor as the table, and there
+ * are no tombstones. Only the header is checked on open; every entry is checked
+ * to lie inside the file before it is used.
+ */
+typedef struct {
+  char magic[SNAPSHOT_MAGIC_SIZE];
+  char hash_name[HASH_TABLE_HASH_NAME_SIZE];
+  uint64_t hash_seed;
+  uint64_t size;
+  uint64_t allocated_size;
+  uint64_t value_size;
+  uint64_t pool_offset;
+  uint64_t file_size;
+} snapshot_header;
+
+typedef struct {
+  uint32_t hash;
+  uint32_t state;
+  uint64_t key_offset;
+  uint64_t key_size;
+  uint64_t value_offset;
+} snapshot_slot;
+
+struct hash_table_snapshot {
+  const unsigned char *data;
+  const snapshot_header *header;
+  const snapshot_slot *slots;
+  hash_table_hash_fn hash_function;
+  hash_table_key_equals_fn key_equals_function;
+};
+
+static size_t align_up(size_t offset, size_t alignment) {
+  return (offset + alignment - 1) & ~(alignment - 1);
+}
+
+static size_t snapshot_pool_offset(size_t allocated_size) {
+  return align_up(sizeof(snapshot_header) +
+                      allocated_size * sizeof(snapshot_slot),
+                  SNAPSHOT_POOL_ALIGNMENT);
+}
+
+static bool write_padding(FILE *file, size_t *position, size_t alignment) {
+  static const char zeros[SNAPSHOT_POOL_ALIGNMENT];
+  size_t padding = align_up(*position, alignment) - *position;
+  *position += padding;
+  return fwrite(zeros, 1, padding, file) == padding;
+}
+
+int hash_table_save(hash_table *table, const char *path,
+                    hash_table_key_size_fn key_size_function,
+                    size_t value_size, hash_table_hash_id hash_id) {
+  size_t hash_name_length = strlen(hash_id.name);
+  if ((table->arena != NULL && value_size != table->value_size) ||
+      hash_name_length >= HASH_TABLE_HASH_NAME_SIZE) {
+    return -2;
+  }
+  size_t allocated_size = capacity_for(table->size);
+  snapshot_slot *slots = calloc(allocated_size, sizeof(snapshot_slot));
+  if (slots == NULL) {
+    return -1;
+  }
+  size_t alignment = value_alignment(value_size);
+  size_t pool_offset = snapshot_pool_offset(allocated_size);
+  size_t offset = pool_offset;
+  size_t cursor = 0;
+  hash_table_slot *slot;
+  while ((slot = next_used_slot(table, &cursor)) != NULL) {
+    size_t index = slot_index(slot->hash, allocated_size);
+    while (slots[index].state != SLOT_EMPTY) {
+      index = (index + LINEAR_STEP) & (allocated_size - 1);
+    }
+    offset = align_up(offset, alignment);
+    slots[index].hash = slot->hash;
+    slots[index].state = SLOT_USED;
+    slots[index].value_offset = offset;
+    offset += value_size;
+    slots[index].key_offset = offset;
+    slots[index].key_size = key_size_function(slot_key(table, slot));
+    offset += slots[index].key_size;
+  }
+  snapshot_header header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, SNAPSHOT_MAGIC, SNAPSHOT_MAGIC_SIZE);
+  memcpy(header.hash_name, hash_id.name, hash_name_length);
+  header.hash_seed = hash_id.seed;
+  header.size = table->size;
+  header.allocated_size = allocated_size;
+  header.value_size = value_size;
+  header.pool_offset = pool_offset;
+  header.file_size = offset;
+  FILE *file = fopen(path, "wb");
+  if (file == NULL) {
+    free(slots);
+    return -3;
+  }
+  size_t position = sizeof(header) + allocated_size * sizeof(snapshot_slot);
+  bool written = fwrite(&header, sizeof(header), 1, file) == 1 &&
+                 fwrite(slots, sizeof(snapshot_slot), allocated_size, file) ==
+                     allocated_size &&
+                 write_padding(file, &position, SNAPSHOT_POOL_ALIGNMENT);
+  free(slots);
+  // The pool is written in the same order the offsets were assigned
+  cursor = 0;
+  while (written && (slot = next_used_slot(table, &cursor)) != NULL) {
+    const void *key = slot_key(table, slot);
+    size_t key_size = key_size_function(key);
+    written = write_padding(file, &position, alignment) &&
+              fwrite(slot->value, 1, value_size, file) == value_size &&
+              fwrite(key, 1, key_size, file) == key_size;
+    position += value_size + key_size;
+  }
+  if (fclose(file) != 0 || !written) {
+    remove(path);
+    return -3;
+  }
+  return 0;
+}
+
+static bool snapshot_header_valid(const snapshot_header *header,
+                                  size_t file_size,
+                                  hash_table_hash_id hash_id) {
+  size_t allocated_size = header->allocated_size;
+  // hash_name is zero-padded, so it is compared including the terminator
+  return memcmp(header->magic, SNAPSHOT_MAGIC, SNAPSHOT_MAGIC_SIZE) == 0 &&
+         strnlen(hash_id.name, HASH_TABLE_HASH_NAME_SIZE) <
+             HASH_TABLE_HASH_NAME_SIZE &&
+         strncmp(header->hash_name, hash_id.name, HASH_TABLE_HASH_NAME_SIZE) ==
+             0 &&
+         header->hash_seed == hash_id.seed &&
+         header->file_size == file_size && allocated_size >= MIN_TABLE_SIZE &&
+         (allocated_size & (allocated_size - 1)) == 0 &&
+         allocated_size <= file_size / sizeof(snapshot_slot) &&
+         header->size < allocated_size &&
+         header->pool_offset == snapshot_pool_offset(allocated_size) &&
+         header->pool_offset <= file_size;
+}
+
+hash_table_snapshot *
+hash_table_snapshot_open(const char *path, hash_table_hash_fn hash_function,
+                         hash_table_key_equals_fn key_equals_function,
+                         hash_table_hash_id hash_id) {
+  int fd = open(path, O_RDONLY);
+  if (fd < 0) {
+    return NULL;
+  }
+  hash_table_snapshot *snapshot = NULL;
+  struct stat file_stat;
+  if (fstat(fd, &file_stat) != 0 ||
+      (size_t)file_stat.st_size < sizeof(snapshot_header)) {
+    goto release_resources;
+  }
+  size_t file_size = file_stat.st_size;
+  void *data = mmap(NULL, file_size, PROT_READ, MAP_SHARED, fd, 0);
+  if (data == MAP_FAILED) {
+    goto release_resources;
+  }
+  if (!snapshot_header_valid(data, file_size, hash_id)) {
+    munmap(data, file_size);
+    goto release_resources;
+  }
+  snapshot = malloc(sizeof(hash_table_snapshot));
+  if (snapshot == NULL) {
+    munmap(data, file_size);
+    goto release_resources;
+  }
+  posix_madvise(data, file_size, POSIX_MADV_RANDOM);
+  snapshot->data = data;
+  snapshot->header = data;
+  snapshot->slots =
+      (const snapshot_slot *)(snapshot->data + sizeof(snapshot_header));
+  snapshot->hash_function = hash_function;
+  snapshot->key_equals_function = key_equals_function;
+release_resources:
+  close(fd);
+  return snapshot;
+}
+
+static bool region_in_pool(const snapshot_header *header, uint64_t offset,
+                           uint64_t size) {
+  return offset >= header->pool_offset && offset <= header->file_size &&
+         size <= header->file_size - offset;
+}
+
+/*
+ * A corrupted entry pointing outside of the pool or with an unterminated key
+ * is treated as absent, so comparing keys never reads past the mapping.
+ */
+static bool snapshot_entry_valid(const hash_table_snapshot *snapshot,
+                                 const snapshot_slot *slot) {
+  const snapshot_header *header = snapshot->header;
+  return slot->key_size > 0 &&
+         region_in_pool(header, slot->key_offset, slot->key_size) &&
+         snapshot->data[slot->key_offset + slot->key_size - 1] == '\0' &&
+         region_in_pool(header, slot->value_offset, header->value_size);
+}
+
+const void *hash_table_snapshot_get(hash_table_snapshot *snapshot,
+                                    const void *key) {
+  unsigned int hash = snapshot->hash_function(key);
+  size_t allocated_size = snapshot->header->allocated_size;
+  size_t index = slot_index(hash, allocated_size);
+  // A valid file always has an empty slot, a corrupted one may not
+  for (size_t step = 0;
+       step < allocated_size && snapshot->slots[index].state == SLOT_USED;
+       step++) {
+    const snapshot_slot *slot = &snapshot->slots[index];
+    if (slot->hash == hash && snapshot_entry_valid(snapshot, slot) &&
+        snapshot->key_equals_function(snapshot->data + slot->key_offset,
+                                      key)) {
+      return snapshot->data + slot->value_offset;
+    }
+    index = (index + LINEAR_STEP) & (allocated_size - 1);
+  }
+  return NULL;
+}
+
+size_t hash_table_snapshot_get_size(hash_table_snapshot *snapshot) {
+  return snapshot->header->size;
+}
+
+size_t hash_table_snapshot_for_each_entry(
+    hash_table_snapshot *snapshot, table_entry_consumer_fn consumer_function) {
+  size_t counter = 0;
+  for (size_t idx = 0; idx < snapshot->header->allocated_size; idx++) {
+    const snapshot_slot *slot = &snapshot->slots[idx];
+    if (slot->state != SLOT_USED || !snapshot_entry_valid(snapshot, slot)) {
+      continue;
+    }
+    consumer_function(snapshot->data + slot->key_offset,
+                      snapshot->data + slot->value_offset);
+    counter++;
+  }
+  return counter;
+}
+
+void hash_table_snapshot_close(hash_table_snapshot *snapshot) {
+  if (snapshot == NULL) {
+    return;
+  }
+  munmap((void *)snapshot->data, snapshot->header->file_size);
+  free(snapshot);
+}
@@ -3,6 +3,7 @@
 
 #include <stdbool.h>
 #include <stddef.h>
+#include <stdint.h>
 
 struct hash_table;
 typedef struct hash_table hash_table;
@@ -15,16 +16,180 @@ typedef unsigned int (*hash_table_hash_fn)(const void *);
 typedef bool (*hash_table_key_equals_fn)(const void *, const void *);
 typedef void (*table_entry_consumer_fn)(const void *, const void *);
 
+/*
+ * Keys and values are bump-allocated from slabs owned by the table and are
+ * released all at once by hash_table_free. All values have the fixed size
+ * given to hash_table_init_ex. Values replaced by hash_table_put and returned
+ * through prev_value stay owned by the table and must not be freed.
+ */
+#define HASH_TABLE_ARENA (1u << 0)
+/*
+ * Robin Hood probing with backward-shift deletion: deleted keys leave no
+ * tombstones, lookups stop as soon as they pass the point where the key would
+ * have been placed, and a table that is not nearly empty grows once a probe
+ * sequence gets longer than a fixed bound. Keys sharing one hash still form a
+ * long chain, since no table size would separate them.
+ */
+#define HASH_TABLE_ROBIN_HOOD (1u << 1)
+/*
+ * Resizing allocates the new slot array but moves entries into it a few slots
+ * per operation instead of all at once; until the move is finished lookups
+ * consult both arrays. Lookups move entries too, so they modify the table and
+ * need the same exclusive access as insertions.
+ */
+#define HASH_TABLE_INCREMENTAL_REHASH (1u << 2)
+/*
+ * Keys are NUL-terminated strings compared byte by byte, key_equals_function
+ * is not used. Keys shorter than 16 bytes are stored in the slots themselves,
+ * so they are neither allocated nor dereferenced while probing; only longer
+ * keys are copied outside the slot array. Keys handed out by iteration point
+ * into the slot array for short keys and stay valid until the table changes.
+ */
+#define HASH_TABLE_INLINE_KEYS (1u << 3)
+
+// The last histogram bucket counts all longer probe sequences
+#define HASH_TABLE_STATS_HISTOGRAM_SIZE 16
+
+typedef struct {
+  size_t size;
+  // Slots of both arrays while an incremental rehash is in progress
+  size_t allocated_size;
+  size_t deleted;
+  size_t max_probe_length;
+  double average_probe_length;
+  size_t probe_length_histogram[HASH_TABLE_STATS_HISTOGRAM_SIZE];
+} hash_table_stats;
+
 hash_table *hash_table_init(hash_table_hash_fn hash_function,
                             hash_table_key_equals_fn key_equals_function,
                             size_t initial_size);
+hash_table *hash_table_init_ex(hash_table_hash_fn hash_function,
+                               hash_table_key_equals_fn key_equals_function,
+                               size_t initial_size, unsigned int flags,
+                               size_t value_size);
+/*
+ * Builds a table from count distinct keys with the slot array allocated at its
+ * final size, so nothing is rehashed and keys are never compared. values holds
+ * count values of value_size bytes each. With thread_count > 1 the slot array
+ * is split into ranges filled in parallel, each thread taking the keys whose
+ * home slot lies in its range; entries that do not fit before the end of their
+ * range are placed afterwards by the calling thread. Returns NULL on error.
+ */
+hash_table *hash_table_build(hash_table_hash_fn hash_function,
+                             hash_table_key_equals_fn key_equals_function,
+                             unsigned int flags, size_t value_size,
+                             const void *const *keys, const size_t *key_sizes,
+                             const void *values, size_t count,
+                             size_t thread_count);
+/*
+ * Grows the table so that entry_count entries fit without resizing. Returns 0
+ * on success.
+ */
+int hash_table_reserve(hash_table *table, size_t entry_count);
 int hash_table_put(hash_table *table, const void *key, size_t key_size,
                    const void *value, size_t value_size, void **prev_value);
+// Not read-only with HASH_TABLE_INCREMENTAL_REHASH, see the flag
 void *hash_table_get(hash_table *table, const void *key);
+/*
+ * Returns the value stored under the key, inserting a copy of initial_value
+ * first if the key is absent. The returned pointer stays valid until the key is
+ * deleted, its value is replaced by hash_table_put or the table is freed.
+ * Returns NULL on error. *inserted (if not NULL) is true only when the key was
+ * actually inserted.
+ */
+void *hash_table_get_or_insert(hash_table *table, const void *key,
+                               size_t key_size, const void *initial_value,
+                               size_t value_size, bool *inserted);
 bool hash_table_delete(hash_table *table, const void *key);
+/*
+ * The same operations for a caller that has already hashed the key with the
+ * table's hash function, e.g. to pick a shard.
+ */
+int hash_table_put_hashed(hash_table *table, const void *key,
+                          unsigned int hash, size_t key_size,
+                          const void *value, size_t value_size,
+                          void **prev_value);
+void *hash_table_get_hashed(hash_table *table, const void *key,
+                            unsigned int hash);
+void *hash_table_get_or_insert_hashed(hash_table *table, const void *key,
+                                      unsigned int hash, size_t key_size,
+                                      const void *initial_value,
+                                      size_t value_size, bool *inserted);
+bool hash_table_delete_hashed(hash_table *table, const void *key,
+                              unsigned int hash);
 void hash_table_free(hash_table *table);
 size_t hash_table_get_size(hash_table *table);
+void hash_table_get_stats(hash_table *table, hash_table_stats *stats);
 size_t hash_table_for_each_entry(hash_table *table,
                                  table_entry_consumer_fn consumer_function);
 
+/*
+ * Cursor over the table entries. The table must not be changed while it is
+ * iterated; with HASH_TABLE_INCREMENTAL_REHASH that includes lookups, which
+ * move entries between slot arrays.
+ */
+typedef struct {
+  size_t position;
+} hash_table_iterator;
+
+void hash_table_iterator_init(hash_table *table, hash_table_iterator *iterator);
+// Returns false when there are no more entries.
+bool hash_table_iterator_next(hash_table *table, hash_table_iterator *iterator,
+                              hash_table_entry *entry);
+/*
+ * Stores up to max_count next entries into entries and returns their number,
+ * 0 when the iteration is over.
+ */
+size_t hash_table_iterator_next_batch(hash_table *table,
+                                      hash_table_iterator *iterator,
+                                      hash_table_entry *entries,
+                                      size_t max_count);
+
+typedef size_t (*hash_table_key_size_fn)(const void *);
+
+#define HASH_TABLE_HASH_NAME_SIZE 16
+
+/*
+ * The hash function of a snapshot: its name (shorter than
+ * HASH_TABLE_HASH_NAME_SIZE) and seed are stored in the file, and the snapshot
+ * can only be opened with the same ones.
+ */
+typedef struct {
+  const char *name;
+  uint64_t seed;
+} hash_table_hash_id;
+
+/*
+ * Writes the table to a snapshot file: a header, a flat slot array and a pool
+ * holding keys and values, with offsets instead of pointers so the file can be
+ * mapped into memory and used without any fixup. Keys must be NUL-terminated
+ * and key_size_function must count the NUL. All values must be value_size
+ * bytes long. Returns 0 on success, -1 when out of memory, -2 on value size
+ * mismatch or a too long hash name and -3 on write error.
+ */
+int hash_table_save(hash_table *table, const char *path,
+                    hash_table_key_size_fn key_size_function,
+                    size_t value_size, hash_table_hash_id hash_id);
+
+struct hash_table_snapshot;
+typedef struct hash_table_snapshot hash_table_snapshot;
+
+/*
+ * Maps a snapshot file read-only. Opening does not depend on the number of
+ * entries: nothing is copied or rehashed. hash_function must be the function
+ * hash_id names, the one the saved table used. Returns NULL if the file cannot
+ * be mapped, is not a snapshot or was saved with another hash_id.
+ */
+hash_table_snapshot *
+hash_table_snapshot_open(const char *path, hash_table_hash_fn hash_function,
+                         hash_table_key_equals_fn key_equals_function,
+                         hash_table_hash_id hash_id);
+// Returns a pointer into the mapped file or NULL if the key is absent
+const void *hash_table_snapshot_get(hash_table_snapshot *snapshot,
+                                    const void *key);
+size_t hash_table_snapshot_get_size(hash_table_snapshot *snapshot);
+size_t hash_table_snapshot_for_each_entry(
+    hash_table_snapshot *snapshot, table_entry_consumer_fn consumer_function);
+void hash_table_snapshot_close(hash_table_snapshot *snapshot);
+
 #endif
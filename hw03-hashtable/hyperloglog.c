@@ -0,0 +1,83 @@
+#include "hyperloglog.h"
+#include <malloc.h>
+#include <math.h>
+
+struct hyperloglog {
+  unsigned int precision;
+  size_t register_count;
+  uint8_t *registers;
+};
+
+hyperloglog *hyperloglog_init(unsigned int precision) {
+  if (precision < HYPERLOGLOG_MIN_PRECISION ||
+      precision > HYPERLOGLOG_MAX_PRECISION) {
+    return NULL;
+  }
+  hyperloglog *counter = malloc(sizeof(hyperloglog));
+  if (counter == NULL) {
+    return NULL;
+  }
+  counter->precision = precision;
+  counter->register_count = (size_t)1 << precision;
+  counter->registers = calloc(counter->register_count, sizeof(uint8_t));
+  if (counter->registers == NULL) {
+    free(counter);
+    return NULL;
+  }
+  return counter;
+}
+
+void hyperloglog_add(hyperloglog *counter, uint64_t hash) {
+  size_t index = hash >> (64 - counter->precision);
+  // Sentinel bit bounds the rank when the remaining bits are all zero
+  uint64_t rest = (hash << counter->precision) |
+                  ((uint64_t)1 << (counter->precision - 1));
+  uint8_t rank = __builtin_clzll(rest) + 1;
+  if (rank > counter->registers[index]) {
+    counter->registers[index] = rank;
+  }
+}
+
+double hyperloglog_estimate(const hyperloglog *counter) {
+  double m = (double)counter->register_count;
+  double alpha;
+  switch (counter->register_count) {
+  case 16:
+    alpha = 0.673;
+    break;
+  case 32:
+    alpha = 0.697;
+    break;
+  case 64:
+    alpha = 0.709;
+    break;
+  default:
+    alpha = 0.7213 / (1.0 + 1.079 / m);
+  }
+  double sum = 0;
+  size_t zero_registers = 0;
+  for (size_t i = 0; i < counter->register_count; i++) {
+    sum += ldexp(1.0, -counter->registers[i]);
+    if (counter->registers[i] == 0) {
+      zero_registers++;
+    }
+  }
+  double estimate = alpha * m * m / sum;
+  // Small range correction: linear counting over empty registers
+  if (estimate <= 2.5 * m && zero_registers > 0) {
+    estimate = m * log(m / zero_registers);
+  }
+  return estimate;
+}
+
+size_t hyperloglog_get_memory(const hyperloglog *counter) {
+  return sizeof(hyperloglog) + counter->register_count;
+}
+
+void hyperloglog_free(hyperloglog *counter) {
+  if (counter == NULL) {
+    return;
+  }
+  free(counter->registers);
+  free(counter);
+}
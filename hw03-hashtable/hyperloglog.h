@@ -0,0 +1,24 @@
+#ifndef HYPERLOGLOG_H
+#define HYPERLOGLOG_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * HyperLogLog distinct count estimator with 2^precision one-byte registers.
+ * The standard error is about 1.04 / sqrt(2^precision).
+ */
+
+#define HYPERLOGLOG_MIN_PRECISION 4
+#define HYPERLOGLOG_MAX_PRECISION 18
+
+struct hyperloglog;
+typedef struct hyperloglog hyperloglog;
+
+hyperloglog *hyperloglog_init(unsigned int precision);
+void hyperloglog_add(hyperloglog *counter, uint64_t hash);
+double hyperloglog_estimate(const hyperloglog *counter);
+size_t hyperloglog_get_memory(const hyperloglog *counter);
+void hyperloglog_free(hyperloglog *counter);
+
+#endif
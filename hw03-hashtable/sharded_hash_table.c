@@ -0,0 +1,192 @@
+#include "sharded_hash_table.h"
+#include <malloc.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define CACHE_LINE_SIZE 64
+#define HASH_BITS 32
+
+typedef struct {
+  pthread_mutex_t lock;
+  hash_table *table;
+} shard;
+
+// Shards are padded to a cache line so that locks of neighbouring shards
+// are not falsely shared between cores.
+typedef union {
+  shard shard;
+  unsigned char padding[((sizeof(shard) + CACHE_LINE_SIZE - 1) /
+                         CACHE_LINE_SIZE) *
+                        CACHE_LINE_SIZE];
+} padded_shard;
+
+struct sharded_hash_table {
+  padded_shard *shards;
+  size_t shard_count;
+  unsigned int shard_shift;
+  hash_table_hash_fn hash_function;
+};
+
+sharded_hash_table *
+sharded_hash_table_init(hash_table_hash_fn hash_function,
+                        hash_table_key_equals_fn key_equals_function,
+                        size_t initial_size, unsigned int flags,
+                        size_t value_size, size_t shard_count) {
+  if (shard_count == 0 || (shard_count & (shard_count - 1)) != 0) {
+    return NULL;
+  }
+  sharded_hash_table *created_table = malloc(sizeof(sharded_hash_table));
+  if (created_table == NULL) {
+    return NULL;
+  }
+  created_table->shards = aligned_alloc(
+      CACHE_LINE_SIZE, sizeof(padded_shard) * shard_count);
+  if (created_table->shards == NULL) {
+    free(created_table);
+    return NULL;
+  }
+  unsigned int shard_bits = 0;
+  while (((size_t)1 << shard_bits) < shard_count) {
+    shard_bits++;
+  }
+  created_table->shard_count = shard_count;
+  created_table->shard_shift = HASH_BITS - shard_bits;
+  created_table->hash_function = hash_function;
+  size_t shard_initial_size = initial_size / shard_count;
+  if (shard_initial_size == 0) {
+    shard_initial_size = 1;
+  }
+  for (size_t i = 0; i < shard_count; i++) {
+    shard *current = &created_table->shards[i].shard;
+    current->table = hash_table_init_ex(hash_function, key_equals_function,
+                                        shard_initial_size, flags, value_size);
+    if (current->table == NULL ||
+        pthread_mutex_init(&current->lock, NULL) != 0) {
+      hash_table_free(current->table);
+      created_table->shard_count = i;
+      sharded_hash_table_free(created_table);
+      return NULL;
+    }
+  }
+  return created_table;
+}
+
+// The key is hashed once: the hash picks the shard and is passed to its table
+static shard *shard_for_hash(sharded_hash_table *table, unsigned int hash) {
+  if (table->shard_count == 1) {
+    return &table->shards[0].shard;
+  }
+  // A shift by the full width is undefined, so one shard is handled above
+  return &table->shards[hash >> table->shard_shift].shard;
+}
+
+int sharded_hash_table_put(sharded_hash_table *table, const void *key,
+                           size_t key_size, const void *value,
+                           size_t value_size, void **prev_value) {
+  unsigned int hash = table->hash_function(key);
+  shard *owner = shard_for_hash(table, hash);
+  pthread_mutex_lock(&owner->lock);
+  int ret_val = hash_table_put_hashed(owner->table, key, hash, key_size,
+                                      value, value_size, prev_value);
+  pthread_mutex_unlock(&owner->lock);
+  return ret_val;
+}
+
+void *sharded_hash_table_get(sharded_hash_table *table, const void *key) {
+  unsigned int hash = table->hash_function(key);
+  shard *owner = shard_for_hash(table, hash);
+  pthread_mutex_lock(&owner->lock);
+  void *value = hash_table_get_hashed(owner->table, key, hash);
+  pthread_mutex_unlock(&owner->lock);
+  return value;
+}
+
+bool sharded_hash_table_get_copy(sharded_hash_table *table, const void *key,
+                                 void *value, size_t value_size) {
+  unsigned int hash = table->hash_function(key);
+  shard *owner = shard_for_hash(table, hash);
+  pthread_mutex_lock(&owner->lock);
+  void *stored_value = hash_table_get_hashed(owner->table, key, hash);
+  if (stored_value != NULL) {
+    memcpy(value, stored_value, value_size);
+  }
+  pthread_mutex_unlock(&owner->lock);
+  return stored_value != NULL;
+}
+
+void *sharded_hash_table_get_or_insert(sharded_hash_table *table,
+                                       const void *key, size_t key_size,
+                                       const void *initial_value,
+                                       size_t value_size, bool *inserted) {
+  unsigned int hash = table->hash_function(key);
+  shard *owner = shard_for_hash(table, hash);
+  pthread_mutex_lock(&owner->lock);
+  void *value = hash_table_get_or_insert_hashed(
+      owner->table, key, hash, key_size, initial_value, value_size, inserted);
+  pthread_mutex_unlock(&owner->lock);
+  return value;
+}
+
+int sharded_hash_table_update(sharded_hash_table *table, const void *key,
+                              size_t key_size, const void *initial_value,
+                              size_t value_size,
+                              sharded_hash_table_update_fn update_function,
+                              void *context) {
+  unsigned int hash = table->hash_function(key);
+  shard *owner = shard_for_hash(table, hash);
+  pthread_mutex_lock(&owner->lock);
+  void *value = hash_table_get_or_insert_hashed(
+      owner->table, key, hash, key_size, initial_value, value_size, NULL);
+  if (value != NULL) {
+    update_function(value, context);
+  }
+  pthread_mutex_unlock(&owner->lock);
+  return value != NULL ? 0 : -1;
+}
+
+bool sharded_hash_table_delete(sharded_hash_table *table, const void *key) {
+  unsigned int hash = table->hash_function(key);
+  shard *owner = shard_for_hash(table, hash);
+  pthread_mutex_lock(&owner->lock);
+  bool ret_val = hash_table_delete_hashed(owner->table, key, hash);
+  pthread_mutex_unlock(&owner->lock);
+  return ret_val;
+}
+
+void sharded_hash_table_free(sharded_hash_table *table) {
+  if (table == NULL) {
+    return;
+  }
+  for (size_t i = 0; i < table->shard_count; i++) {
+    shard *current = &table->shards[i].shard;
+    pthread_mutex_destroy(&current->lock);
+    hash_table_free(current->table);
+  }
+  free(table->shards);
+  free(table);
+}
+
+size_t sharded_hash_table_get_size(sharded_hash_table *table) {
+  size_t size = 0;
+  for (size_t i = 0; i < table->shard_count; i++) {
+    shard *current = &table->shards[i].shard;
+    pthread_mutex_lock(&current->lock);
+    size += hash_table_get_size(current->table);
+    pthread_mutex_unlock(&current->lock);
+  }
+  return size;
+}
+
+size_t
+sharded_hash_table_for_each_entry(sharded_hash_table *table,
+                                  table_entry_consumer_fn consumer_function) {
+  size_t counter = 0;
+  for (size_t i = 0; i < table->shard_count; i++) {
+    shard *current = &table->shards[i].shard;
+    pthread_mutex_lock(&current->lock);
+    counter += hash_table_for_each_entry(current->table, consumer_function);
+    pthread_mutex_unlock(&current->lock);
+  }
+  return counter;
+}
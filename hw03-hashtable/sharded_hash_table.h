@@ -0,0 +1,53 @@
+#ifndef SHARDED_HASH_TABLE_H
+#define SHARDED_HASH_TABLE_H
+
+#include "hash_table.h"
+
+/*
+ * Thread-safe hash table made of independently locked hash_table shards. The
+ * shard is selected by the high bits of the key hash, which is computed once
+ * and passed to the shard table. The shard table places the key by the high
+ * bits of the Fibonacci-mixed hash, which depend on every bit of the hash, so
+ * keys of one shard still spread over all of its slots. Every call locks only
+ * the shard that owns the key.
+ */
+
+struct sharded_hash_table;
+typedef struct sharded_hash_table sharded_hash_table;
+
+typedef void (*sharded_hash_table_update_fn)(void *value, void *context);
+
+sharded_hash_table *
+sharded_hash_table_init(hash_table_hash_fn hash_function,
+                        hash_table_key_equals_fn key_equals_function,
+                        size_t initial_size, unsigned int flags,
+                        size_t value_size, size_t shard_count);
+int sharded_hash_table_put(sharded_hash_table *table, const void *key,
+                           size_t key_size, const void *value,
+                           size_t value_size, void **prev_value);
+/*
+ * Pointers returned by get and get_or_insert are not protected by the shard
+ * lock: they may only be dereferenced while no other thread deletes or
+ * replaces the same key. Use sharded_hash_table_update to modify values
+ * concurrently.
+ */
+void *sharded_hash_table_get(sharded_hash_table *table, const void *key);
+bool sharded_hash_table_get_copy(sharded_hash_table *table, const void *key,
+                                 void *value, size_t value_size);
+void *sharded_hash_table_get_or_insert(sharded_hash_table *table,
+                                       const void *key, size_t key_size,
+                                       const void *initial_value,
+                                       size_t value_size, bool *inserted);
+int sharded_hash_table_update(sharded_hash_table *table, const void *key,
+                              size_t key_size, const void *initial_value,
+                              size_t value_size,
+                              sharded_hash_table_update_fn update_function,
+                              void *context);
+bool sharded_hash_table_delete(sharded_hash_table *table, const void *key);
+void sharded_hash_table_free(sharded_hash_table *table);
+size_t sharded_hash_table_get_size(sharded_hash_table *table);
+size_t
+sharded_hash_table_for_each_entry(sharded_hash_table *table,
+                                  table_entry_consumer_fn consumer_function);
+
+#endif
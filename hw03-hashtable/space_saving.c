@@ -0,0 +1,167 @@
+#include "space_saving.h"
+#include <malloc.h>
+#include <string.h>
+
+#define INITIAL_TABLE_FACTOR 2
+
+typedef struct {
+  char *word;
+  uint64_t count;
+  // Heap position of the word, stored as its value in the table
+  size_t *position;
+} monitored_word;
+
+struct space_saving {
+  hash_table *table;
+  monitored_word *heap;
+  size_t size;
+  size_t capacity;
+};
+
+space_saving *space_saving_init(size_t capacity,
+                                hash_table_hash_fn hash_function,
+                                hash_table_key_equals_fn key_equals_function) {
+  if (capacity == 0) {
+    return NULL;
+  }
+  space_saving *counter = malloc(sizeof(space_saving));
+  if (counter == NULL) {
+    return NULL;
+  }
+  // Evicted keys must really be freed, so the table is not arena-backed
+  counter->table = hash_table_init_ex(
+      hash_function, key_equals_function, capacity * INITIAL_TABLE_FACTOR,
+      HASH_TABLE_ROBIN_HOOD, sizeof(size_t));
+  counter->heap = malloc(sizeof(monitored_word) * capacity);
+  if (counter->table == NULL || counter->heap == NULL) {
+    hash_table_free(counter->table);
+    free(counter->heap);
+    free(counter);
+    return NULL;
+  }
+  counter->size = 0;
+  counter->capacity = capacity;
+  return counter;
+}
+
+static void heap_swap(space_saving *counter, size_t a, size_t b) {
+  monitored_word temp = counter->heap[a];
+  counter->heap[a] = counter->heap[b];
+  counter->heap[b] = temp;
+  *counter->heap[a].position = a;
+  *counter->heap[b].position = b;
+}
+
+static void heap_sift_down(space_saving *counter, size_t index) {
+  while (true) {
+    size_t smallest = index;
+    size_t left = index * 2 + 1;
+    size_t right = left + 1;
+    if (left < counter->size &&
+        counter->heap[left].count < counter->heap[smallest].count) {
+      smallest = left;
+    }
+    if (right < counter->size &&
+        counter->heap[right].count < counter->heap[smallest].count) {
+      smallest = right;
+    }
+    if (smallest == index) {
+      return;
+    }
+    heap_swap(counter, index, smallest);
+    index = smallest;
+  }
+}
+
+static void heap_sift_up(space_saving *counter, size_t index) {
+  while (index > 0) {
+    size_t parent = (index - 1) / 2;
+    if (counter->heap[parent].count <= counter->heap[index].count) {
+      return;
+    }
+    heap_swap(counter, index, parent);
+    index = parent;
+  }
+}
+
+static int monitor_word(space_saving *counter, const char *word,
+                        size_t length, size_t heap_index, uint64_t count) {
+  char *word_copy = malloc(length + 1);
+  if (word_copy == NULL) {
+    return -1;
+  }
+  memcpy(word_copy, word, length + 1);
+  size_t *position = hash_table_get_or_insert(
+      counter->table, word, length + 1, &heap_index, sizeof(size_t), NULL);
+  if (position == NULL) {
+    free(word_copy);
+    return -1;
+  }
+  counter->heap[heap_index].word = word_copy;
+  counter->heap[heap_index].count = count;
+  counter->heap[heap_index].position = position;
+  return 0;
+}
+
+int space_saving_add(space_saving *counter, const char *word, size_t length,
+                     uint64_t upper_bound) {
+  size_t *position = hash_table_get(counter->table, word);
+  if (position != NULL) {
+    counter->heap[*position].count++;
+    heap_sift_down(counter, *position);
+    return 0;
+  }
+  if (counter->size < counter->capacity) {
+    if (monitor_word(counter, word, length, counter->size, 1) != 0) {
+      return -1;
+    }
+    counter->size++;
+    heap_sift_up(counter, counter->size - 1);
+    return 0;
+  }
+  // The smallest count does not bound the frequency of an unmonitored word
+  // once it has been lowered by a tight upper bound, only upper_bound does
+  if (upper_bound <= counter->heap[0].count) {
+    return 0;
+  }
+  char *evicted_word = counter->heap[0].word;
+  if (monitor_word(counter, word, length, 0, upper_bound) != 0) {
+    return -1;
+  }
+  hash_table_delete(counter->table, evicted_word);
+  free(evicted_word);
+  heap_sift_down(counter, 0);
+  return 0;
+}
+
+word_stat *space_saving_get_top(space_saving *counter, size_t *count) {
+  word_stat *stats =
+      malloc(sizeof(word_stat) * (counter->size > 0 ? counter->size : 1));
+  if (stats == NULL) {
+    return NULL;
+  }
+  for (size_t i = 0; i < counter->size; i++) {
+    stats[i].word = counter->heap[i].word;
+    stats[i].count = counter->heap[i].count;
+  }
+  *count = counter->size;
+  if (!word_stats_sort(stats, counter->size, 1)) {
+    free(stats);
+    return NULL;
+  }
+  return stats;
+}
+
+size_t space_saving_get_size(space_saving *counter) { return counter->size; }
+
+void space_saving_free(space_saving *counter) {
+  if (counter == NULL) {
+    return;
+  }
+  for (size_t i = 0; i < counter->size; i++) {
+    free(counter->heap[i].word);
+  }
+  hash_table_free(counter->table);
+  free(counter->heap);
+  free(counter);
+}
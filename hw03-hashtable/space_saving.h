@@ -0,0 +1,37 @@
+#ifndef SPACE_SAVING_H
+#define SPACE_SAVING_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "hash_table.h"
+#include "word_stats.h"
+
+/*
+ * Space-Saving heavy hitters: monitors at most capacity words. A word that is
+ * not monitored starts with the independent upper bound of its frequency
+ * passed to space_saving_add and replaces the word with the smallest count if
+ * that bound is larger. Counts never undercount as long as the bounds do not.
+ * The smallest counts are the least reliable, so monitor more words than are
+ * reported.
+ */
+
+struct space_saving;
+typedef struct space_saving space_saving;
+
+space_saving *space_saving_init(size_t capacity, hash_table_hash_fn hash_function,
+                                hash_table_key_equals_fn key_equals_function);
+/*
+ * Counts one occurrence of the NUL-terminated word. upper_bound is an
+ * independent upper bound of the word frequency including this occurrence
+ * (e.g. a Count-Min Sketch estimate), used as the count of a newly monitored
+ * word.
+ */
+int space_saving_add(space_saving *counter, const char *word, size_t length,
+                     uint64_t upper_bound);
+// Monitored words sorted by count. Words point into the counter.
+word_stat *space_saving_get_top(space_saving *counter, size_t *count);
+size_t space_saving_get_size(space_saving *counter);
+void space_saving_free(space_saving *counter);
+
+#endif
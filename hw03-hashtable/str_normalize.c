@@ -2,56 +2,131 @@
 #include <string.h>
 
 #if ENABLE_UNICODE_USING_LOCALE
-#include <malloc.h>
-#include <stdlib.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
 #include <wchar.h>
 #include <wctype.h>
 
-char *str_normalize(char *string) {
-  char *ret_val = NULL;
-  size_t wordlen = strlen(string);
-  size_t wstring_size = sizeof(wchar_t) * (wordlen + 1);
-  wchar_t *wide_string = malloc(wstring_size * sizeof(wchar_t));
-  if (wide_string == NULL) {
-    goto release_resources;
-  }
-  int wcoper_res_code = mbstowcs(wide_string, string, wstring_size);
-  if (wcoper_res_code == -1) {
-    perror("mbstowcs");
-    goto release_resources;
-  }
-  for (size_t i = 0; i < wcslen(wide_string); i++) {
-    wide_string[i] = towlower(wide_string[i]);
-  }
-  char *result_string = malloc(wstring_size);
-  if (result_string == NULL) {
-    goto release_resources;
-  }
-  wcoper_res_code = wcstombs(result_string, wide_string, wstring_size);
-  if (wcoper_res_code == -1) {
-    perror("wcstombs");
-    goto release_resources;
-  }
-  ret_val = result_string;
-release_resources:
-  if (ret_val == NULL) {
-    free(result_string);
-  }
-  free(wide_string);
-  return ret_val;
+#define ASCII_HIGH_BITS 0x8080808080808080ull
+#define ASCII_LOW_BITS 0x7F7F7F7F7F7F7F7Full
+#define BYTES_ONES 0x0101010101010101ull
+#define TWO_BYTE_CODEPOINTS 0x800
+
+// Lowercase form of every codepoint encoded by two UTF-8 bytes.
+static uint16_t two_byte_lower_table[TWO_BYTE_CODEPOINTS];
+static pthread_once_t two_byte_lower_table_once = PTHREAD_ONCE_INIT;
+
+static bool is_two_byte_codepoint(wint_t codepoint) {
+  return codepoint >= 0x80 && codepoint < TWO_BYTE_CODEPOINTS;
 }
 
-#else
+static void init_two_byte_lower_table(void) {
+  for (uint16_t codepoint = 0; codepoint < TWO_BYTE_CODEPOINTS; codepoint++) {
+    uint16_t lower = codepoint;
+    if (codepoint >= 0xC0 && codepoint <= 0xDE && codepoint != 0xD7) {
+      lower = codepoint + 0x20; // Latin-1
+    } else if (codepoint >= 0x400 && codepoint <= 0x40F) {
+      lower = codepoint + 0x50; // Ѐ-Џ
+    } else if (codepoint >= 0x410 && codepoint <= 0x42F) {
+      lower = codepoint + 0x20; // А-Я
+    } else if (codepoint >= 0x80) {
+      wint_t locale_lower = towlower(codepoint);
+      if (is_two_byte_codepoint(locale_lower)) {
+        lower = locale_lower;
+      }
+    }
+    two_byte_lower_table[codepoint] = lower;
+  }
+}
+
+static uint64_t ascii_lower_8(uint64_t chunk) {
+  // Each byte is < 0x80, so per-byte additions never carry into the next byte
+  uint64_t above_z = chunk + (0x7F - 'Z') * BYTES_ONES;
+  uint64_t from_a = chunk + (0x80 - 'A') * BYTES_ONES;
+  uint64_t is_upper = from_a & ~above_z & ASCII_HIGH_BITS;
+  return chunk | (is_upper >> 2);
+}
+
+static size_t utf8_sequence_length(unsigned char lead) {
+  if ((lead & 0xE0) == 0xC0) {
+    return 2;
+  }
+  if ((lead & 0xF0) == 0xE0) {
+    return 3;
+  }
+  if ((lead & 0xF8) == 0xF0) {
+    return 4;
+  }
+  return 0;
+}
 
-#include <malloc.h>
+static void lower_long_sequence(unsigned char *sequence, size_t length) {
+  wint_t codepoint = sequence[0] & (0xFF >> (length + 1));
+  for (size_t i = 1; i < length; i++) {
+    codepoint = (codepoint << 6) | (sequence[i] & 0x3F);
+  }
+  wint_t lower = towlower(codepoint);
+  size_t lower_length = lower < 0x10000 ? 3 : 4;
+  if (lower == codepoint || lower < 0x800 || lower_length != length) {
+    return;
+  }
+  for (size_t i = length - 1; i > 0; i--) {
+    sequence[i] = 0x80 | (lower & 0x3F);
+    lower >>= 6;
+  }
+  sequence[0] = (length == 3 ? 0xE0 : 0xF0) | lower;
+}
 
-char *str_normalize(char *string) {
-  char *copy = malloc(sizeof(char) * strlen(string) + 1);
-  if (copy == NULL) {
-    return NULL;
+void str_normalize(char *string, size_t length) {
+  pthread_once(&two_byte_lower_table_once, init_two_byte_lower_table);
+  unsigned char *bytes = (unsigned char *)string;
+  size_t i = 0;
+  while (i < length) {
+    if (i + sizeof(uint64_t) <= length) {
+      uint64_t chunk;
+      memcpy(&chunk, bytes + i, sizeof(chunk));
+      if ((chunk & ASCII_HIGH_BITS) == 0) {
+        chunk = ascii_lower_8(chunk & ASCII_LOW_BITS);
+        memcpy(bytes + i, &chunk, sizeof(chunk));
+        i += sizeof(chunk);
+        continue;
+      }
+    }
+    unsigned char lead = bytes[i];
+    if (lead < 0x80) {
+      if (lead >= 'A' && lead <= 'Z') {
+        bytes[i] = lead + ('a' - 'A');
+      }
+      i++;
+      continue;
+    }
+    size_t sequence_length = utf8_sequence_length(lead);
+    bool valid = sequence_length > 0 && i + sequence_length <= length;
+    for (size_t j = 1; valid && j < sequence_length; j++) {
+      valid = (bytes[i + j] & 0xC0) == 0x80;
+    }
+    if (!valid) {
+      i++;
+      continue;
+    }
+    if (sequence_length == 2) {
+      uint16_t codepoint = ((lead & 0x1F) << 6) | (bytes[i + 1] & 0x3F);
+      uint16_t lower = two_byte_lower_table[codepoint];
+      bytes[i] = 0xC0 | (lower >> 6);
+      bytes[i + 1] = 0x80 | (lower & 0x3F);
+    } else {
+      lower_long_sequence(bytes + i, sequence_length);
+    }
+    i += sequence_length;
   }
-  strcpy(copy, string);
-  return copy;
+}
+
+#else
+
+void str_normalize(char *string, size_t length) {
+  (void)string;
+  (void)length;
 }
 
 #endif
@@ -1,6 +1,12 @@
 #ifndef STR_NORMALIZE_H
 #define STR_NORMALIZE_H
 
-char *str_normalize(char *string);
+#include <stddef.h>
+
+/*
+ * Lowercases the UTF-8 string in place. Only characters whose lowercase form
+ * has the same encoded length are changed, so the length never changes.
+ */
+void str_normalize(char *string, size_t length);
 
 #endif
@@ -0,0 +1,207 @@
+#include "string_intern.h"
+#include <malloc.h>
+#include <string.h>
+
+#define INITIAL_STRING_CAPACITY 1024
+#define AVERAGE_STRING_SIZE 8
+#define MIN_INDEX_SIZE 16
+#define FIBONACCI_MULTIPLIER 2654435769u
+
+// An index slot is empty when its id is STRING_INTERN_NO_ID
+typedef struct {
+  uint32_t hash;
+  uint32_t id;
+} index_slot;
+
+struct string_intern {
+  hash_table_hash_fn hash_function;
+  /*
+   * Open addressing index of ids, at most half full. hash_table callbacks get
+   * no context to reach the pool, so ids are indexed here: strings are only
+   * stored in the pool and a candidate id is compared through its offset.
+   */
+  index_slot *index;
+  size_t index_size;
+  char *pool;
+  size_t pool_size;
+  size_t pool_capacity;
+  // Pool offset of the string with each id
+  size_t *offsets;
+  size_t count;
+  size_t capacity;
+};
+
+static size_t index_size_for(size_t count) {
+  size_t index_size = MIN_INDEX_SIZE;
+  while (index_size / 2 < count) {
+    index_size <<= 1;
+  }
+  return index_size;
+}
+
+static index_slot *alloc_index(size_t index_size) {
+  index_slot *index = malloc(sizeof(index_slot) * index_size);
+  if (index != NULL) {
+    for (size_t i = 0; i < index_size; i++) {
+      index[i].id = STRING_INTERN_NO_ID;
+    }
+  }
+  return index;
+}
+
+static size_t home_slot(uint32_t hash, size_t index_size) {
+  uint32_t mixed = hash * FIBONACCI_MULTIPLIER;
+  return ((uint64_t)mixed * index_size) >> 32;
+}
+
+string_intern *string_intern_init(hash_table_hash_fn hash_function,
+                                  size_t expected_count) {
+  string_intern *intern = malloc(sizeof(string_intern));
+  if (intern == NULL) {
+    return NULL;
+  }
+  intern->hash_function = hash_function;
+  intern->capacity = expected_count > INITIAL_STRING_CAPACITY
+                         ? expected_count
+                         : INITIAL_STRING_CAPACITY;
+  intern->pool_capacity = intern->capacity * AVERAGE_STRING_SIZE;
+  intern->index_size = index_size_for(expected_count);
+  intern->index = alloc_index(intern->index_size);
+  intern->pool = malloc(intern->pool_capacity);
+  intern->offsets = malloc(intern->capacity * sizeof(size_t));
+  if (intern->index == NULL || intern->pool == NULL ||
+      intern->offsets == NULL) {
+    string_intern_free(intern);
+    return NULL;
+  }
+  intern->pool_size = 0;
+  intern->count = 0;
+  return intern;
+}
+
+/*
+ * Returns the slot holding the string or the empty slot where it belongs. The
+ * index is never full, so the probe always ends.
+ */
+static index_slot *find_slot(const string_intern *intern, const char *string,
+                             size_t length, uint32_t hash) {
+  size_t mask = intern->index_size - 1;
+  size_t position = home_slot(hash, intern->index_size);
+  while (true) {
+    index_slot *slot = &intern->index[position];
+    if (slot->id == STRING_INTERN_NO_ID ||
+        (slot->hash == hash &&
+         strncmp(intern->pool + intern->offsets[slot->id], string,
+                 length + 1) == 0)) {
+      return slot;
+    }
+    position = (position + 1) & mask;
+  }
+}
+
+static bool grow_index(string_intern *intern) {
+  size_t index_size = intern->index_size * 2;
+  index_slot *index = alloc_index(index_size);
+  if (index == NULL) {
+    return false;
+  }
+  for (size_t i = 0; i < intern->index_size; i++) {
+    index_slot slot = intern->index[i];
+    if (slot.id == STRING_INTERN_NO_ID) {
+      continue;
+    }
+    size_t position = home_slot(slot.hash, index_size);
+    while (index[position].id != STRING_INTERN_NO_ID) {
+      position = (position + 1) & (index_size - 1);
+    }
+    index[position] = slot;
+  }
+  free(intern->index);
+  intern->index = index;
+  intern->index_size = index_size;
+  return true;
+}
+
+static bool append_string(string_intern *intern, const char *string,
+                          size_t length) {
+  if (intern->count == intern->capacity) {
+    size_t *offsets =
+        realloc(intern->offsets, intern->capacity * 2 * sizeof(size_t));
+    if (offsets == NULL) {
+      return false;
+    }
+    intern->offsets = offsets;
+    intern->capacity *= 2;
+  }
+  if (intern->pool_size + length + 1 > intern->pool_capacity) {
+    size_t pool_capacity = intern->pool_capacity * 2;
+    while (intern->pool_size + length + 1 > pool_capacity) {
+      pool_capacity *= 2;
+    }
+    char *pool = realloc(intern->pool, pool_capacity);
+    if (pool == NULL) {
+      return false;
+    }
+    intern->pool = pool;
+    intern->pool_capacity = pool_capacity;
+  }
+  memcpy(intern->pool + intern->pool_size, string, length);
+  intern->pool[intern->pool_size + length] = '\0';
+  intern->offsets[intern->count++] = intern->pool_size;
+  intern->pool_size += length + 1;
+  return true;
+}
+
+uint32_t string_intern_add(string_intern *intern, const char *string,
+                           size_t length) {
+  uint32_t hash = intern->hash_function(string);
+  index_slot *slot = find_slot(intern, string, length, hash);
+  if (slot->id != STRING_INTERN_NO_ID) {
+    return slot->id;
+  }
+  if (intern->count == STRING_INTERN_NO_ID) {
+    return STRING_INTERN_NO_ID;
+  }
+  if (intern->count + 1 > intern->index_size / 2) {
+    if (!grow_index(intern)) {
+      return STRING_INTERN_NO_ID;
+    }
+    slot = find_slot(intern, string, length, hash);
+  }
+  if (!append_string(intern, string, length)) {
+    return STRING_INTERN_NO_ID;
+  }
+  slot->hash = hash;
+  slot->id = (uint32_t)(intern->count - 1);
+  return slot->id;
+}
+
+uint32_t string_intern_find(string_intern *intern, const char *string) {
+  uint32_t hash = intern->hash_function(string);
+  return find_slot(intern, string, strlen(string), hash)->id;
+}
+
+const char *string_intern_get(const string_intern *intern, uint32_t id) {
+  if (id >= intern->count) {
+    return NULL;
+  }
+  return intern->pool + intern->offsets[id];
+}
+
+size_t string_intern_get_size(const string_intern *intern) {
+  return intern->count;
+}
+
+size_t string_intern_get_pool_size(const string_intern *intern) {
+  return intern->pool_size;
+}
+
+void string_intern_free(string_intern *intern) {
+  if (intern == NULL) {
+    return;
+  }
+  free(intern->index);
+  free(intern->pool);
+  free(intern->offsets);
+  free(intern);
+}
@@ -0,0 +1,44 @@
+#ifndef STRING_INTERN_H
+#define STRING_INTERN_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "hash_table.h"
+
+/*
+ * Assigns dense 32-bit ids to distinct NUL-terminated strings in the order
+ * they are first added. Every string is copied once into a contiguous pool
+ * that serves id -> string lookups, while an index of ids hashed by
+ * hash_function maps strings to ids by comparing them with the pool.
+ * Ids never change, so they can be stored, compared and joined instead of the
+ * strings themselves.
+ */
+
+#define STRING_INTERN_NO_ID UINT32_MAX
+
+struct string_intern;
+typedef struct string_intern string_intern;
+
+// expected_count distinct strings fit without resizing, 0 if unknown
+string_intern *string_intern_init(hash_table_hash_fn hash_function,
+                                  size_t expected_count);
+/*
+ * Returns the id of the string, adding it first if it has not been seen yet.
+ * Returns STRING_INTERN_NO_ID on error or when all ids are taken.
+ */
+uint32_t string_intern_add(string_intern *intern, const char *string,
+                           size_t length);
+// Returns STRING_INTERN_NO_ID if the string has not been added
+uint32_t string_intern_find(string_intern *intern, const char *string);
+/*
+ * Returns the string with the given id. The pointer goes into the pool and
+ * stays valid until the next string_intern_add, which may move the pool.
+ */
+const char *string_intern_get(const string_intern *intern, uint32_t id);
+size_t string_intern_get_size(const string_intern *intern);
+// Bytes taken by the pool, including the terminating NULs
+size_t string_intern_get_pool_size(const string_intern *intern);
+void string_intern_free(string_intern *intern);
+
+#endif
@@ -0,0 +1,254 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "hash_functions.h"
+#include "hash_table.h"
+
+#define KEY_COUNT 20000
+#define KEY_SIZE 48
+#define HASH_FUNCTION "wy"
+#define BUILD_THREADS 4
+// Every LONG_KEY_PERIOD-th key does not fit into an inline slot
+#define LONG_KEY_PERIOD 3
+
+#define CHECK(condition)                                                       \
+  do {                                                                         \
+    if (!(condition)) {                                                        \
+      fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__,         \
+              #condition);                                                     \
+      return false;                                                            \
+    }                                                                          \
+  } while (0)
+
+static const unsigned int table_flags[] = {
+    0,
+    HASH_TABLE_ARENA,
+    HASH_TABLE_ROBIN_HOOD,
+    HASH_TABLE_INCREMENTAL_REHASH,
+    HASH_TABLE_INLINE_KEYS,
+    HASH_TABLE_ARENA | HASH_TABLE_INLINE_KEYS,
+    HASH_TABLE_ROBIN_HOOD | HASH_TABLE_INLINE_KEYS,
+    HASH_TABLE_INCREMENTAL_REHASH | HASH_TABLE_INLINE_KEYS,
+    HASH_TABLE_ARENA | HASH_TABLE_ROBIN_HOOD | HASH_TABLE_INCREMENTAL_REHASH,
+};
+
+static hash_table_hash_fn key_hash;
+static char keys[KEY_COUNT][KEY_SIZE];
+static const void *key_pointers[KEY_COUNT];
+static size_t key_sizes[KEY_COUNT];
+static size_t values[KEY_COUNT];
+
+static bool key_equals(const void *key1, const void *key2) {
+  return strcmp(key1, key2) == 0;
+}
+
+static size_t key_size(const void *key) { return strlen(key) + 1; }
+
+static void generate_keys(void) {
+  for (size_t i = 0; i < KEY_COUNT; i++) {
+    snprintf(keys[i], KEY_SIZE,
+             i % LONG_KEY_PERIOD == 0 ? "long key number %zu" : "k%zu", i);
+    key_pointers[i] = keys[i];
+    key_sizes[i] = strlen(keys[i]) + 1;
+    values[i] = i * 7 + 1;
+  }
+}
+
+static hash_table *create_table(unsigned int flags) {
+  return hash_table_init_ex(key_hash, key_equals, 8, flags, sizeof(size_t));
+}
+
+static bool put_all(hash_table *table) {
+  for (size_t i = 0; i < KEY_COUNT; i++) {
+    CHECK(hash_table_put(table, keys[i], key_sizes[i], &values[i],
+                         sizeof(size_t), NULL) == 0);
+  }
+  CHECK(hash_table_get_size(table) == KEY_COUNT);
+  return true;
+}
+
+static bool check_all(hash_table *table, size_t first, size_t step) {
+  for (size_t i = first; i < KEY_COUNT; i += step) {
+    const size_t *value = hash_table_get(table, keys[i]);
+    CHECK(value != NULL && *value == values[i]);
+  }
+  return true;
+}
+
+static bool test_put_get_delete(unsigned int flags) {
+  bool ok = false;
+  hash_table *table = create_table(flags);
+  CHECK(table != NULL);
+  if (!put_all(table) || !check_all(table, 0, 1)) {
+    goto resources_release;
+  }
+  CHECK(hash_table_get(table, "absent key") == NULL);
+  // Replacing a value returns the previous one
+  size_t replacement = 0;
+  void *prev_value = NULL;
+  CHECK(hash_table_put(table, keys[1], key_sizes[1], &replacement,
+                       sizeof(size_t), &prev_value) == 0);
+  CHECK(prev_value != NULL && *(size_t *)prev_value == values[1]);
+  if (!(flags & HASH_TABLE_ARENA)) {
+    free(prev_value);
+  }
+  CHECK(*(size_t *)hash_table_get(table, keys[1]) == 0);
+  CHECK(hash_table_put(table, keys[1], key_sizes[1], &values[1],
+                       sizeof(size_t), NULL) == 0);
+  CHECK(hash_table_get_size(table) == KEY_COUNT);
+  // Every other key is deleted, the rest stay reachable
+  for (size_t i = 0; i < KEY_COUNT; i += 2) {
+    CHECK(hash_table_delete(table, keys[i]));
+  }
+  CHECK(!hash_table_delete(table, keys[0]));
+  CHECK(hash_table_get_size(table) == KEY_COUNT / 2);
+  for (size_t i = 0; i < KEY_COUNT; i += 2) {
+    CHECK(hash_table_get(table, keys[i]) == NULL);
+  }
+  if (!check_all(table, 1, 2)) {
+    goto resources_release;
+  }
+  // Deleted keys are inserted again by get_or_insert
+  for (size_t i = 0; i < KEY_COUNT; i += 2) {
+    bool inserted = false;
+    size_t *value = hash_table_get_or_insert(
+        table, keys[i], key_sizes[i], &values[i], sizeof(size_t), &inserted);
+    CHECK(value != NULL && inserted && *value == values[i]);
+  }
+  bool inserted = true;
+  size_t *value = hash_table_get_or_insert(
+      table, keys[1], key_sizes[1], &replacement, sizeof(size_t), &inserted);
+  CHECK(value != NULL && !inserted && *value == values[1]);
+  CHECK(hash_table_get_size(table) == KEY_COUNT);
+  ok = check_all(table, 0, 1);
+resources_release:
+  hash_table_free(table);
+  return ok;
+}
+
+// Every key is seen exactly once, by both kinds of iteration
+static bool check_iteration(hash_table *table) {
+  static bool seen[KEY_COUNT];
+  memset(seen, 0, sizeof(seen));
+  hash_table_iterator iterator;
+  hash_table_entry entry;
+  size_t count = 0;
+  hash_table_iterator_init(table, &iterator);
+  while (hash_table_iterator_next(table, &iterator, &entry)) {
+    size_t index = (*(const size_t *)entry.value - 1) / 7;
+    CHECK(index < KEY_COUNT && !seen[index]);
+    CHECK(strcmp(entry.key, keys[index]) == 0);
+    seen[index] = true;
+    count++;
+  }
+  CHECK(count == KEY_COUNT);
+  hash_table_entry entries[64];
+  size_t batch_size;
+  count = 0;
+  hash_table_iterator_init(table, &iterator);
+  while ((batch_size = hash_table_iterator_next_batch(table, &iterator,
+                                                      entries, 64)) > 0) {
+    count += batch_size;
+  }
+  CHECK(count == KEY_COUNT);
+  return true;
+}
+
+static bool test_iterate(unsigned int flags) {
+  hash_table *table = create_table(flags);
+  CHECK(table != NULL);
+  bool ok = put_all(table) && check_iteration(table);
+  hash_table_free(table);
+  return ok;
+}
+
+static bool test_build(unsigned int flags, size_t thread_count) {
+  hash_table *table = hash_table_build(key_hash, key_equals, flags,
+                                       sizeof(size_t), key_pointers, key_sizes,
+                                       values, KEY_COUNT, thread_count);
+  CHECK(table != NULL);
+  bool ok = hash_table_get_size(table) == KEY_COUNT &&
+            check_all(table, 0, 1) && check_iteration(table) &&
+            hash_table_get(table, "absent key") == NULL;
+  hash_table_free(table);
+  CHECK(ok);
+  return true;
+}
+
+static bool check_snapshot(const char *path, hash_table_hash_id hash_id) {
+  hash_table_snapshot *snapshot =
+      hash_table_snapshot_open(path, key_hash, key_equals, hash_id);
+  CHECK(snapshot != NULL);
+  bool ok = hash_table_snapshot_get_size(snapshot) == KEY_COUNT &&
+            hash_table_snapshot_get(snapshot, "absent key") == NULL;
+  for (size_t i = 0; ok && i < KEY_COUNT; i++) {
+    const size_t *value = hash_table_snapshot_get(snapshot, keys[i]);
+    ok = value != NULL && *value == values[i];
+  }
+  hash_table_snapshot_close(snapshot);
+  CHECK(ok);
+  return true;
+}
+
+static bool test_snapshot(unsigned int flags) {
+  char path[] = "/tmp/hash_table_test_XXXXXX";
+  int fd = mkstemp(path);
+  CHECK(fd >= 0);
+  close(fd);
+  bool ok = false;
+  hash_table_hash_id hash_id = {HASH_FUNCTION, hash_functions_get_seed()};
+  hash_table_hash_id other_seed = {HASH_FUNCTION, hash_id.seed + 1};
+  hash_table_hash_id other_name = {"fnv1a", hash_id.seed};
+  hash_table *table = create_table(flags);
+  if (table == NULL || !put_all(table)) {
+    goto resources_release;
+  }
+  if (hash_table_save(table, path, key_size, sizeof(size_t), hash_id) != 0) {
+    fprintf(stderr, "%s:%d: cannot save snapshot\n", __FILE__, __LINE__);
+    goto resources_release;
+  }
+  if (!check_snapshot(path, hash_id)) {
+    goto resources_release;
+  }
+  // A snapshot saved with another hash function is not opened
+  ok = hash_table_snapshot_open(path, key_hash, key_equals, other_seed) ==
+           NULL &&
+       hash_table_snapshot_open(path, key_hash, key_equals, other_name) ==
+           NULL;
+  if (!ok) {
+    fprintf(stderr, "%s:%d: snapshot opened with another hash\n", __FILE__,
+            __LINE__);
+  }
+resources_release:
+  hash_table_free(table);
+  unlink(path);
+  return ok;
+}
+
+int main(void) {
+  key_hash = hash_functions_get_by_name(HASH_FUNCTION);
+  generate_keys();
+  size_t failed = 0;
+  size_t flags_count = sizeof(table_flags) / sizeof(table_flags[0]);
+  for (size_t i = 0; i < flags_count; i++) {
+    unsigned int flags = table_flags[i];
+    bool ok = test_put_get_delete(flags) && test_iterate(flags) &&
+              test_build(flags, 1) && test_build(flags, BUILD_THREADS) &&
+              test_snapshot(flags);
+    printf("flags %2u: %s\n", flags, ok ? "ok" : "FAILED");
+    if (!ok) {
+      failed++;
+    }
+  }
+  if (failed > 0) {
+    printf("%zu of %zu flag sets failed\n", failed, flags_count);
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,148 @@
+#include "tokenizer.h"
+#include <stdint.h>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#define SPAN_BATCH_SIZE 64
+
+// Bit N is set when byte N is a delimiter.
+static const uint8_t delimiter_bitmap[32] = {
+    0x00, 0x3E, 0x00, 0x00, 0xFF, 0xFF, 0x00, 0xFC, 0x01, 0x00, 0x00,
+    0xF8, 0x01, 0x00, 0x00, 0x78, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+};
+
+bool tokenizer_is_delimiter(char symbol) {
+  uint8_t byte = (uint8_t)symbol;
+  return (delimiter_bitmap[byte >> 3] >> (byte & 7)) & 1;
+}
+
+/*
+ * Delimiters are the byte ranges [9, 13], [32, 47], [58, 64], [91, 96] and
+ * [123, 126]. Signed byte comparisons never match bytes >= 0x80.
+ */
+#if defined(__AVX2__)
+#define VECTOR_SIZE 32
+typedef __m256i vector_t;
+
+static inline vector_t in_range(vector_t chunk, char low, char high) {
+  return _mm256_and_si256(_mm256_cmpgt_epi8(chunk, _mm256_set1_epi8(low - 1)),
+                          _mm256_cmpgt_epi8(_mm256_set1_epi8(high + 1), chunk));
+}
+
+static inline uint32_t delimiter_mask(const char *data) {
+  vector_t chunk = _mm256_loadu_si256((const vector_t *)data);
+  vector_t mask = _mm256_or_si256(
+      _mm256_or_si256(in_range(chunk, 9, 13), in_range(chunk, 32, 47)),
+      _mm256_or_si256(
+          _mm256_or_si256(in_range(chunk, 58, 64), in_range(chunk, 91, 96)),
+          in_range(chunk, 123, 126)));
+  return (uint32_t)_mm256_movemask_epi8(mask);
+}
+#elif defined(__SSE2__)
+#define VECTOR_SIZE 16
+typedef __m128i vector_t;
+
+static inline vector_t in_range(vector_t chunk, char low, char high) {
+  return _mm_and_si128(_mm_cmpgt_epi8(chunk, _mm_set1_epi8(low - 1)),
+                       _mm_cmplt_epi8(chunk, _mm_set1_epi8(high + 1)));
+}
+
+static inline uint32_t delimiter_mask(const char *data) {
+  vector_t chunk = _mm_loadu_si128((const vector_t *)data);
+  vector_t mask = _mm_or_si128(
+      _mm_or_si128(in_range(chunk, 9, 13), in_range(chunk, 32, 47)),
+      _mm_or_si128(_mm_or_si128(in_range(chunk, 58, 64),
+                                in_range(chunk, 91, 96)),
+                   in_range(chunk, 123, 126)));
+  return (uint32_t)_mm_movemask_epi8(mask);
+}
+#endif
+
+const char *tokenizer_simd_name(void) {
+#if defined(__AVX2__)
+  return "AVX2";
+#elif defined(__SSE2__)
+  return "SSE2";
+#else
+  return "scalar";
+#endif
+}
+
+static size_t scan(const char *data, size_t size, size_t position,
+                   bool find_delimiter) {
+#ifdef VECTOR_SIZE
+  const uint32_t all_bits = (uint32_t)((1ull << VECTOR_SIZE) - 1);
+  while (position + VECTOR_SIZE <= size) {
+    uint32_t mask = delimiter_mask(data + position);
+    if (!find_delimiter) {
+      mask = ~mask & all_bits;
+    }
+    if (mask != 0) {
+      return position + __builtin_ctz(mask);
+    }
+    position += VECTOR_SIZE;
+  }
+#endif
+  while (position < size &&
+         tokenizer_is_delimiter(data[position]) != find_delimiter) {
+    position++;
+  }
+  return position;
+}
+
+size_t tokenizer_next_delimiter(const char *data, size_t size,
+                                size_t position) {
+  return scan(data, size, position, true);
+}
+
+size_t tokenizer_skip_delimiters(const char *data, size_t size,
+                                 size_t position) {
+  return scan(data, size, position, false);
+}
+
+size_t tokenizer_find_spans(const char *data, size_t size, size_t *position,
+                            tokenizer_span spans[], size_t max_spans) {
+  size_t span_count = 0;
+  size_t word_start = tokenizer_skip_delimiters(data, size, *position);
+  while (span_count < max_spans && word_start < size) {
+    size_t word_end = tokenizer_next_delimiter(data, size, word_start);
+    if (word_end == size) {
+      break;
+    }
+    spans[span_count].offset = word_start;
+    spans[span_count].length = word_end - word_start;
+    span_count++;
+    word_start = tokenizer_skip_delimiters(data, size, word_end + 1);
+  }
+  *position = word_start;
+  return span_count;
+}
+
+int tokenize_buffer(const char *data, size_t size,
+                    tokenizer_word_fn word_processor_fn, void *context,
+                    size_t *words) {
+  tokenizer_span spans[SPAN_BATCH_SIZE];
+  size_t position = 0;
+  size_t span_count;
+  while ((span_count = tokenizer_find_spans(data, size, &position, spans,
+                                            SPAN_BATCH_SIZE)) > 0) {
+    for (size_t i = 0; i < span_count; i++) {
+      (*words)++;
+      int process_res = word_processor_fn(data + spans[i].offset,
+                                          spans[i].length, context);
+      if (process_res != 0) {
+        return process_res;
+      }
+    }
+  }
+  if (position < size) {
+    (*words)++;
+    return word_processor_fn(data + position, size - position, context);
+  }
+  return 0;
+}
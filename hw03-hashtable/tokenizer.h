@@ -0,0 +1,39 @@
+#ifndef TOKENIZER_H
+#define TOKENIZER_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/*
+ * Words are separated by ASCII whitespace and punctuation (isspace/ispunct in
+ * the "C" locale). Bytes >= 0x80 always belong to words, so UTF-8 encoded text
+ * is split the same way in every locale.
+ */
+
+typedef struct {
+  size_t offset;
+  size_t length;
+} tokenizer_span;
+
+typedef int (*tokenizer_word_fn)(const char *word, size_t length,
+                                 void *context);
+
+bool tokenizer_is_delimiter(char symbol);
+size_t tokenizer_next_delimiter(const char *data, size_t size, size_t position);
+size_t tokenizer_skip_delimiters(const char *data, size_t size,
+                                 size_t position);
+/*
+ * Finds up to max_spans words starting from *position that are terminated by a
+ * delimiter. *position is left at the start of the first word not reported
+ * yet, so a word running up to the end of data can be handled (or carried
+ * over to the next buffer) by the caller.
+ */
+size_t tokenizer_find_spans(const char *data, size_t size, size_t *position,
+                            tokenizer_span spans[], size_t max_spans);
+// The vector instruction set of the build: "AVX2", "SSE2" or "scalar"
+const char *tokenizer_simd_name(void);
+int tokenize_buffer(const char *data, size_t size,
+                    tokenizer_word_fn word_processor_fn, void *context,
+                    size_t *words);
+
+#endif
@@ -1,49 +1,215 @@
-#include <ctype.h>
+#define _GNU_SOURCE
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <getopt.h>
 #include <locale.h>
 #include <malloc.h>
+#include <pthread.h>
 #include <stdbool.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 #include <wchar.h>
 
+#include "buffered_writer.h"
+#include "count_min_sketch.h"
+#include "hash_functions.h"
 #include "hash_table.h"
+#include "hyperloglog.h"
+#include "space_saving.h"
 #include "str_normalize.h"
+#include "string_intern.h"
+#include "tokenizer.h"
+#include "word_stats.h"
 
-#define BUFFER_SIZE 1000
-#define INITIAL_WORD_BUFFER_SIZE 100
+#define BUFFER_SIZE (64 * 1024)
+#define SPAN_BATCH_SIZE 64
 #define INITIAL_TABLE_SIZE 1000
+#define MAX_THREADS 256
+#define MIN_CHUNK_SIZE (64 * 1024)
+#define WORD_STACK_BUFFER_SIZE 256
+#define ENTRY_BATCH_SIZE 64
+#define INITIAL_FILE_CAPACITY 64
+#define DEFAULT_HASH_FUNCTION "wy"
+#define SKETCH_WIDTH (1 << 18)
+#define SKETCH_DEPTH 4
+// Space-Saving следит за большим числом слов, чем выводится
+#define APPROX_CANDIDATE_FACTOR 4
+#define HYPERLOGLOG_PRECISION 14
+#define MIN_NGRAM_SIZE 2
+#define MAX_NGRAM_SIZE 8
+
+typedef enum {
+  OUTPUT_UNORDERED,
+  OUTPUT_TOP,
+  OUTPUT_SORTED,
+  OUTPUT_APPROXIMATE,
+  OUTPUT_LOOKUP
+} output_mode;
+
+typedef struct {
+  const char *data;
+  size_t size;
+  hash_table *table;
+  size_t words;
+  int result;
+} chunk_count_task;
+
+typedef struct {
+  char *path;
+  size_t bytes;
+  size_t words;
+  int result;
+  // errno неудавшегося открытия или чтения файла
+  int error;
+} file_task;
+
+// Очередь файлов, которые потоки разбирают по одному
+typedef struct {
+  file_task *files;
+  size_t count;
+  size_t capacity;
+  size_t next_file;
+  // Пути, которые не удалось открыть при обходе, они пропускаются
+  size_t skipped_paths;
+  pthread_mutex_t lock;
+} file_queue;
 
-#define HASH_SEED 42
+typedef struct {
+  file_queue *queue;
+  hash_table *table;
+} file_worker;
 
-size_t word_counter = 0;
+typedef int (*word_processor)(char *word, size_t length, size_t counter,
+                              void *context);
 
-hash_table *words_hash_table = NULL;
+// Оценки приближенного подсчета
+typedef struct {
+  count_min_sketch *sketch;
+  hyperloglog *distinct_words;
+  space_saving *heavy_hitters;
+} approx_counter;
+
+typedef struct {
+  hash_table_snapshot *snapshot;
+  buffered_writer *writer;
+} snapshot_lookup;
+
+/*
+ * Словарь слово -> номер и таблица n-грамм, ключ которой - кортеж номеров
+ * последних size слов. Кортеж заканчивается STRING_INTERN_NO_ID, как строка
+ * заканчивается '\0', поэтому функциям таблицы не нужно знать size.
+ */
+typedef struct {
+  string_intern *words;
+  hash_table *table;
+  size_t size;
+  size_t count;
+  uint32_t window[MAX_NGRAM_SIZE + 1];
+  size_t window_fill;
+} ngram_counter;
 
 void print_usage(const char *app_name) {
-  printf("Usage: %s [in_file]\n", app_name);
+  printf("Usage: %s [-j threads] [-H hash_function] [-n words] [-g N] [-p] "
+         "[--top N | --sort | --approx N] [--save snapshot | --lookup "
+         "snapshot] [in_file | paths...]\n",
+         app_name);
+  printf("  -j, --threads N  count words of in_file (and sort them) in "
+         "parallel, 0 - one thread per CPU\n");
+  printf("  paths  files and directories (searched recursively) counted "
+         "together by -j threads\n");
+  printf("  -p, --per-file  print bytes and words of every file counted\n");
+  printf("  -t, --top N  print only N most frequent words\n");
+  printf("  -s, --sort  print all words sorted by frequency\n");
+  printf("  -a, --approx N  estimate N most frequent words and the number of "
+         "distinct words in fixed memory\n");
+  printf("  -g, --ngram N  count sequences of N consecutive words (%d-%d) "
+         "instead of single words\n",
+         MIN_NGRAM_SIZE, MAX_NGRAM_SIZE);
+  printf("  -n, --words N  expected number of distinct words, the table is "
+         "allocated for them up front\n");
+  printf("  -S, --save FILE  save counted words to a snapshot file\n");
+  printf("  -l, --lookup FILE  print counts of in_file words from a snapshot "
+         "file saved with the same hash function\n");
+  printf("  -H, --hash hash_function  one of:");
+  size_t function_count;
+  const hash_function_descriptor *functions =
+      hash_functions_get_all(&function_count);
+  for (size_t i = 0; i < function_count; i++) {
+    printf(" %s", functions[i].name);
+  }
+  printf(" (default: %s)\n", DEFAULT_HASH_FUNCTION);
 }
 
-void print_word_stat(const void *word, const void *count) {
-  char *the_word = (char *)word;
-  size_t *the_count = (size_t *)count;
-  printf("%s: %zu\n", the_word, *the_count);
+bool print_word_stat(buffered_writer *writer, const char *word, size_t count) {
+  buffered_writer_write_string(writer, word);
+  buffered_writer_write(writer, ": ", 2);
+  buffered_writer_write_size(writer, count);
+  return buffered_writer_write(writer, "\n", 1);
 }
 
-void print_word_stats(void) {
-  printf("Total word count: %zu\n", hash_table_get_size(words_hash_table));
-  printf("\n");
-  hash_table_for_each_entry(words_hash_table, print_word_stat);
+void print_all_word_stats(buffered_writer *writer, hash_table *table) {
+  hash_table_entry entries[ENTRY_BATCH_SIZE];
+  hash_table_iterator iterator;
+  hash_table_iterator_init(table, &iterator);
+  size_t batch_size;
+  while ((batch_size = hash_table_iterator_next_batch(
+              table, &iterator, entries, ENTRY_BATCH_SIZE)) > 0) {
+    for (size_t i = 0; i < batch_size; i++) {
+      print_word_stat(writer, entries[i].key,
+                      *(const size_t *)entries[i].value);
+    }
+  }
 }
 
-unsigned int word_hash(const void *data) {
-  const char *word = data;
-  unsigned int hash = HASH_SEED;
-  while (*word) {
-    hash = hash * 101 + *word++;
+int print_word_stats(hash_table *table, output_mode mode, size_t top_count,
+                     size_t thread_count) {
+  printf("Total word count: %zu\n", hash_table_get_size(table));
+  printf("\n");
+  buffered_writer *stats_writer = buffered_writer_init(stdout, 0);
+  if (stats_writer == NULL) {
+    return -1;
   }
-  return hash;
+  int ret_val = 0;
+  word_stat *stats = NULL;
+  size_t stats_count = 0;
+  switch (mode) {
+  case OUTPUT_UNORDERED:
+    print_all_word_stats(stats_writer, table);
+    break;
+  case OUTPUT_TOP:
+    stats = word_stats_top(table, top_count, &stats_count);
+    if (stats == NULL) {
+      ret_val = -2;
+      break;
+    }
+    word_stats_write(stats_writer, stats, stats_count);
+    break;
+  case OUTPUT_SORTED:
+    stats = word_stats_collect(table, &stats_count);
+    if (stats == NULL ||
+        !word_stats_sort(stats, stats_count, thread_count)) {
+      ret_val = -2;
+      break;
+    }
+    word_stats_write(stats_writer, stats, stats_count);
+    break;
+  case OUTPUT_APPROXIMATE:
+  case OUTPUT_LOOKUP:
+    break;
+  }
+  free(stats);
+  if (!buffered_writer_free(stats_writer) && ret_val == 0) {
+    perror("Error writing stats");
+    ret_val = -3;
+  }
+  return ret_val;
 }
 
 bool word_equals(const void *key1, const void *key2) {
@@ -52,130 +218,901 @@ bool word_equals(const void *key1, const void *key2) {
   return strcmp(word1, word2) == 0;
 }
 
-int add_and_increment_word(const char *word) {
-  size_t *count = hash_table_get(words_hash_table, word);
+size_t word_size(const void *key) { return strlen(key) + 1; }
+
+hash_table *create_words_table(hash_table_hash_fn word_hash,
+                               size_t expected_words) {
+  hash_table *table = hash_table_init_ex(
+      word_hash, word_equals, INITIAL_TABLE_SIZE,
+      HASH_TABLE_ARENA | HASH_TABLE_INLINE_KEYS, sizeof(size_t));
+  if (table != NULL && hash_table_reserve(table, expected_words) != 0) {
+    hash_table_free(table);
+    return NULL;
+  }
+  return table;
+}
+
+int add_and_increment_word(hash_table *table, const char *word,
+                           size_t length, size_t increment) {
+  size_t initial_count = 0;
+  size_t *count =
+      hash_table_get_or_insert(table, word, (length + 1) * sizeof(char),
+                               &initial_count, sizeof(size_t), NULL);
   if (count == NULL) {
-    size_t count_val = 1;
-    int put_res = hash_table_put(words_hash_table, word,
-                                 (strlen(word) + 1) * sizeof(char), &count_val,
-                                 sizeof(size_t), NULL);
-    if (put_res != 0) {
-      return put_res;
-    }
-  } else {
-    (*count)++;
+    return -1;
   }
+  *count += increment;
   return 0;
 }
 
-int process_word(char *word, size_t counter) {
-  int ret_val = 0;
-  char *normalized_string = str_normalize(word);
-  if (normalized_string == NULL) {
-    fprintf(stderr, "Cannot normalize word '%s'", word);
-    ret_val = -1;
-    goto resources_release;
-  }
-  int increment_res = add_and_increment_word(normalized_string);
+int process_word(char *word, size_t length, size_t counter, void *context) {
+  str_normalize(word, length);
+  int increment_res = add_and_increment_word(context, word, length, 1);
   if (increment_res != 0) {
     fprintf(stderr, "Cannot count word #%zu %s, code: %d", counter, word,
             increment_res);
-    ret_val = -2;
-    goto resources_release;
-  };
-resources_release:
-  free(normalized_string);
-  return ret_val;
+    return -2;
+  }
+  return 0;
 }
 
-int tokenize_by_words(FILE *infile, int (*word_processor_fn)(char *, size_t)) {
+/*
+ * Буфер output (если есть) сбрасывается перед итогами чтения, чтобы вывод
+ * word_processor_fn не перемешался с ними.
+ */
+int tokenize_by_words(FILE *infile, word_processor word_processor_fn,
+                      void *context, buffered_writer *output) {
   int ret_val = 0;
-  size_t bytes_read = 0;
   size_t bytes = 0;
   size_t words = 0;
-  char buf[BUFFER_SIZE + 1];
-  size_t current_word_buffer_size = INITIAL_WORD_BUFFER_SIZE;
-  size_t current_word_size = 0;
-  size_t buf_word_start_pos = 0;
-  char *current_word_buffer = malloc(sizeof(char) * INITIAL_WORD_BUFFER_SIZE);
-  if (current_word_buffer == NULL) {
+  size_t buffer_size = BUFFER_SIZE;
+  // Начало слова, не закончившегося в предыдущем блоке
+  size_t pending_size = 0;
+  tokenizer_span spans[SPAN_BATCH_SIZE];
+  char *buf = malloc(sizeof(char) * (buffer_size + 1));
+  if (buf == NULL) {
     return 2;
   }
   while (!feof(infile)) {
-    bytes_read = fread(buf, sizeof(uint8_t), BUFFER_SIZE, infile);
+    if (pending_size == buffer_size) {
+      char *new_buf = realloc(buf, buffer_size * 2 + 1);
+      if (new_buf == NULL) {
+        ret_val = -2;
+        goto resources_release;
+      }
+      buf = new_buf;
+      buffer_size *= 2;
+    }
+    size_t bytes_read = fread(buf + pending_size, sizeof(uint8_t),
+                              buffer_size - pending_size, infile);
     if (ferror(infile)) {
       perror("Error reading file");
       ret_val = -1;
       goto resources_release;
     }
     bytes += bytes_read;
-    size_t buffer_index = 0;
-    buf_word_start_pos = 0;
-    bool last_symbol_is_delimiter = false;
-    while (buffer_index < bytes_read) {
-      while (buffer_index < bytes_read &&
-             !(last_symbol_is_delimiter = (ispunct(buf[buffer_index]) ||
-                                           isspace(buf[buffer_index])))) {
-        buffer_index++;
-      }
-      size_t bytes_to_add_to_word = buffer_index - buf_word_start_pos;
-      if (bytes_to_add_to_word > 0) {
-        if (current_word_size + bytes_to_add_to_word + 1 >
-            current_word_buffer_size) {
-          char *new_current_word_buffer =
-              realloc(current_word_buffer,
-                      bytes_to_add_to_word * 2 + current_word_buffer_size + 1);
-          if (new_current_word_buffer == NULL) {
-            ret_val = -2;
-            goto resources_release;
-          }
-          current_word_buffer = new_current_word_buffer;
-        }
-        strncpy(current_word_buffer + current_word_size,
-                buf + buf_word_start_pos, bytes_to_add_to_word);
-        current_word_size += bytes_to_add_to_word;
-      }
-      if (buffer_index == bytes_read && !last_symbol_is_delimiter) {
-        continue; // Прочитали весь буфер но конец слова не нашли
-      }
-      // Нашли конец слова
-      if (current_word_size > 0) {
-        current_word_buffer[current_word_size] = '\0';
+    size_t data_size = pending_size + bytes_read;
+    size_t position = 0;
+    size_t span_count;
+    while ((span_count = tokenizer_find_spans(buf, data_size, &position, spans,
+                                              SPAN_BATCH_SIZE)) > 0) {
+      for (size_t i = 0; i < span_count; i++) {
+        // Слово заканчивается разделителем, его можно заменить на '\0'
+        // вместо копирования слова
+        char *word = buf + spans[i].offset;
+        word[spans[i].length] = '\0';
         words++;
-        int process_res = word_processor_fn(current_word_buffer, words);
-        if (process_res != 0) {
+        if (word_processor_fn(word, spans[i].length, words, context) != 0) {
           ret_val = -3;
           goto resources_release;
         }
       }
-      buf_word_start_pos = buffer_index + 1;
-      current_word_size = 0;
-      buffer_index++;
     }
+    pending_size = data_size - position;
+    memmove(buf, buf + position, pending_size);
   }
-  if (current_word_size > 0) {
-    current_word_buffer[current_word_size] = '\0';
-    word_processor_fn(current_word_buffer, words);
+  if (pending_size > 0) {
+    buf[pending_size] = '\0';
     words++;
+    if (word_processor_fn(buf, pending_size, words, context) != 0) {
+      ret_val = -3;
+      goto resources_release;
+    }
+  }
+  if (output != NULL && !buffered_writer_flush(output)) {
+    ret_val = -4;
+    goto resources_release;
+  }
+  printf("\n");
+  printf("Bytes read: %zu\n", bytes);
+  printf("Words recognized: %zu\n", words);
+resources_release:
+  free(buf);
+  return ret_val;
+}
+
+int process_word_approx(char *word, size_t length, size_t counter,
+                        void *context) {
+  approx_counter *counter_state = context;
+  str_normalize(word, length);
+  uint64_t hash = hash_bytes_wy64(word, length);
+  hyperloglog_add(counter_state->distinct_words, hash);
+  uint64_t upper_bound = count_min_sketch_add(counter_state->sketch, hash);
+  if (space_saving_add(counter_state->heavy_hitters, word, length,
+                       upper_bound) != 0) {
+    fprintf(stderr, "Cannot count word #%zu %s", counter, word);
+    return -1;
+  }
+  return 0;
+}
+
+/*
+ * Приближенный подсчет в фиксированном объеме памяти: частоты слов оцениваются
+ * Count-Min Sketch, самые частые слова отбираются Space-Saving, количество
+ * различных слов оценивается HyperLogLog.
+ */
+int count_words_approximate(FILE *infile, size_t top_count,
+                            hash_table_hash_fn word_hash) {
+  int ret_val = 0;
+  word_stat *stats = NULL;
+  approx_counter counter;
+  counter.sketch = count_min_sketch_init(SKETCH_WIDTH, SKETCH_DEPTH);
+  counter.distinct_words = hyperloglog_init(HYPERLOGLOG_PRECISION);
+  counter.heavy_hitters = space_saving_init(
+      top_count * APPROX_CANDIDATE_FACTOR, word_hash, word_equals);
+  if (counter.sketch == NULL || counter.distinct_words == NULL ||
+      counter.heavy_hitters == NULL) {
+    fprintf(stderr, "Error creating sketches\n");
+    ret_val = -1;
+    goto resources_release;
+  }
+  if (tokenize_by_words(infile, process_word_approx, &counter, NULL) != 0) {
+    ret_val = -2;
+    goto resources_release;
+  }
+  printf("Distinct words (estimate): %.0f\n",
+         hyperloglog_estimate(counter.distinct_words));
+  printf("Sketch memory: %zu bytes\n",
+         count_min_sketch_get_memory(counter.sketch) +
+             hyperloglog_get_memory(counter.distinct_words));
+  printf("\n");
+  size_t stats_count = 0;
+  stats = space_saving_get_top(counter.heavy_hitters, &stats_count);
+  if (stats == NULL && stats_count > 0) {
+    ret_val = -3;
+    goto resources_release;
+  }
+  if (stats_count > top_count) {
+    stats_count = top_count;
+  }
+  buffered_writer *stats_writer = buffered_writer_init(stdout, 0);
+  if (stats_writer == NULL) {
+    ret_val = -3;
+    goto resources_release;
+  }
+  word_stats_write(stats_writer, stats, stats_count);
+  if (!buffered_writer_free(stats_writer)) {
+    perror("Error writing stats");
+    ret_val = -4;
+  }
+resources_release:
+  free(stats);
+  count_min_sketch_free(counter.sketch);
+  hyperloglog_free(counter.distinct_words);
+  space_saving_free(counter.heavy_hitters);
+  return ret_val;
+}
+
+int process_word_lookup(char *word, size_t length, size_t counter,
+                        void *context) {
+  (void)counter;
+  snapshot_lookup *lookup = context;
+  str_normalize(word, length);
+  const size_t *count = hash_table_snapshot_get(lookup->snapshot, word);
+  size_t found_count = count != NULL ? *count : 0;
+  return print_word_stat(lookup->writer, word, found_count) ? 0 : -1;
+}
+
+// Слова входного файла ищутся в отображенном в память снимке таблицы
+int lookup_words(FILE *infile, const char *snapshot_name,
+                 hash_table_hash_fn word_hash, hash_table_hash_id hash_id) {
+  int ret_val = 0;
+  snapshot_lookup lookup;
+  lookup.snapshot =
+      hash_table_snapshot_open(snapshot_name, word_hash, word_equals, hash_id);
+  if (lookup.snapshot == NULL) {
+    fprintf(stderr,
+            "Cannot open snapshot %s (or it was saved with another hash "
+            "function)\n",
+            snapshot_name);
+    return -1;
+  }
+  lookup.writer = buffered_writer_init(stdout, 0);
+  if (lookup.writer == NULL) {
+    ret_val = -2;
+    goto resources_release;
+  }
+  if (tokenize_by_words(infile, process_word_lookup, &lookup, lookup.writer) !=
+      0) {
+    ret_val = -3;
+  }
+  if (!buffered_writer_free(lookup.writer) && ret_val == 0) {
+    perror("Error writing stats");
+    ret_val = -4;
+  }
+  printf("Snapshot word count: %zu\n",
+         hash_table_snapshot_get_size(lookup.snapshot));
+resources_release:
+  hash_table_snapshot_close(lookup.snapshot);
+  return ret_val;
+}
+
+size_t ngram_length(const uint32_t *ids) {
+  size_t length = 0;
+  while (ids[length] != STRING_INTERN_NO_ID) {
+    length++;
+  }
+  return length;
+}
+
+unsigned int ngram_hash(const void *key) {
+  return (unsigned int)hash_bytes_wy64(key,
+                                       ngram_length(key) * sizeof(uint32_t));
+}
+
+bool ngram_equals(const void *key1, const void *key2) {
+  const uint32_t *ids1 = key1;
+  const uint32_t *ids2 = key2;
+  while (*ids1 == *ids2) {
+    if (*ids1 == STRING_INTERN_NO_ID) {
+      return true;
+    }
+    ids1++;
+    ids2++;
+  }
+  return false;
+}
+
+/*
+ * Слово заменяется своим номером в словаре, в таблицу добавляется кортеж
+ * номеров последних ngram->size слов, строки n-грамм при этом не собираются.
+ */
+int process_word_ngram(char *word, size_t length, size_t counter,
+                       void *context) {
+  ngram_counter *ngram = context;
+  str_normalize(word, length);
+  uint32_t id = string_intern_add(ngram->words, word, length);
+  if (id == STRING_INTERN_NO_ID) {
+    fprintf(stderr, "Cannot add word #%zu %s to the vocabulary", counter,
+            word);
+    return -1;
+  }
+  if (ngram->window_fill == ngram->size) {
+    memmove(ngram->window, ngram->window + 1,
+            (ngram->size - 1) * sizeof(uint32_t));
+    ngram->window_fill--;
+  }
+  ngram->window[ngram->window_fill++] = id;
+  if (ngram->window_fill < ngram->size) {
+    return 0;
+  }
+  size_t initial_count = 0;
+  size_t *count = hash_table_get_or_insert(
+      ngram->table, ngram->window, (ngram->size + 1) * sizeof(uint32_t),
+      &initial_count, sizeof(size_t), NULL);
+  if (count == NULL) {
+    fprintf(stderr, "Cannot count n-gram ending with word #%zu %s", counter,
+            word);
+    return -2;
+  }
+  (*count)++;
+  ngram->count++;
+  return 0;
+}
+
+/*
+ * Переводит посчитанные n-граммы в таблицу слов, чтобы выводить и сохранять
+ * их так же, как слова. Строка собирается один раз для каждой различной
+ * n-граммы.
+ */
+int ngrams_to_words(const ngram_counter *ngram, hash_table *words_table) {
+  int ret_val = 0;
+  size_t text_capacity = WORD_STACK_BUFFER_SIZE;
+  char *text = malloc(text_capacity);
+  if (text == NULL) {
+    return -1;
+  }
+  hash_table_entry entry;
+  hash_table_iterator iterator;
+  hash_table_iterator_init(ngram->table, &iterator);
+  while (hash_table_iterator_next(ngram->table, &iterator, &entry)) {
+    const uint32_t *ids = entry.key;
+    size_t length = 0;
+    for (size_t i = 0; i < ngram->size; i++) {
+      length += strlen(string_intern_get(ngram->words, ids[i])) + 1;
+    }
+    if (length > text_capacity) {
+      char *new_text = realloc(text, length);
+      if (new_text == NULL) {
+        ret_val = -2;
+        goto resources_release;
+      }
+      text = new_text;
+      text_capacity = length;
+    }
+    char *end = text;
+    for (size_t i = 0; i < ngram->size; i++) {
+      if (i > 0) {
+        *end++ = ' ';
+      }
+      end = stpcpy(end, string_intern_get(ngram->words, ids[i]));
+    }
+    if (add_and_increment_word(words_table, text, end - text,
+                               *(const size_t *)entry.value) != 0) {
+      ret_val = -3;
+      goto resources_release;
+    }
+  }
+resources_release:
+  free(text);
+  return ret_val;
+}
+
+int count_ngrams(FILE *infile, size_t ngram_size, hash_table_hash_fn word_hash,
+                 hash_table **words_table) {
+  int ret_val = 0;
+  ngram_counter ngram;
+  memset(&ngram, 0, sizeof(ngram));
+  ngram.size = ngram_size;
+  ngram.window[ngram_size] = STRING_INTERN_NO_ID;
+  ngram.words = string_intern_init(word_hash, 0);
+  ngram.table = hash_table_init_ex(ngram_hash, ngram_equals, INITIAL_TABLE_SIZE,
+                                   HASH_TABLE_ARENA, sizeof(size_t));
+  if (ngram.words == NULL || ngram.table == NULL) {
+    fprintf(stderr, "Error creating hash table\n");
+    ret_val = -1;
+    goto resources_release;
+  }
+  if (tokenize_by_words(infile, process_word_ngram, &ngram, NULL) != 0) {
+    ret_val = -2;
+    goto resources_release;
+  }
+  printf("Distinct words: %zu\n", string_intern_get_size(ngram.words));
+  printf("N-grams recognized: %zu\n", ngram.count);
+  *words_table =
+      create_words_table(word_hash, hash_table_get_size(ngram.table));
+  if (*words_table == NULL || ngrams_to_words(&ngram, *words_table) != 0) {
+    fprintf(stderr, "Error converting n-grams to text\n");
+    ret_val = -3;
+  }
+resources_release:
+  hash_table_free(ngram.table);
+  string_intern_free(ngram.words);
+  return ret_val;
+}
+
+int count_chunk_word(const char *word, size_t length, void *context) {
+  chunk_count_task *task = context;
+  char stack_buffer[WORD_STACK_BUFFER_SIZE];
+  char *word_copy =
+      length < sizeof(stack_buffer) ? stack_buffer : malloc(length + 1);
+  if (word_copy == NULL) {
+    return -1;
+  }
+  memcpy(word_copy, word, length);
+  word_copy[length] = '\0';
+  str_normalize(word_copy, length);
+  int ret_val = add_and_increment_word(task->table, word_copy, length, 1);
+  if (word_copy != stack_buffer) {
+    free(word_copy);
+  }
+  return ret_val;
+}
+
+void *count_chunk(void *arg) {
+  chunk_count_task *task = arg;
+  task->result = tokenize_buffer(task->data, task->size, count_chunk_word,
+                                 task, &task->words);
+  return NULL;
+}
+
+int merge_word_counts(hash_table *target, hash_table *source) {
+  hash_table_iterator iterator;
+  hash_table_entry entry;
+  hash_table_iterator_init(source, &iterator);
+  while (hash_table_iterator_next(source, &iterator, &entry)) {
+    const char *word = entry.key;
+    const size_t *count = entry.value;
+    if (add_and_increment_word(target, word, strlen(word), *count) != 0) {
+      return -1;
+    }
+  }
+  return 0;
+}
+
+/*
+ * Файл отображается в память и делится на части по границам слов, каждая
+ * часть считается в своем потоке в собственную таблицу, затем таблицы
+ * сливаются в первую, она возвращается в words_table.
+ */
+int count_words_parallel(int fd, size_t file_size, size_t thread_count,
+                         hash_table_hash_fn word_hash, size_t expected_words,
+                         hash_table **words_table) {
+  // Пустой файл нельзя отобразить в память, а считать в нем нечего
+  if (file_size == 0) {
+    *words_table = create_words_table(word_hash, expected_words);
+    if (*words_table == NULL) {
+      fprintf(stderr, "Error creating hash table\n");
+      return -2;
+    }
+    printf("\n");
+    printf("Bytes read: 0\n");
+    printf("Words recognized: 0\n");
+    return 0;
+  }
+  int ret_val = 0;
+  if (thread_count > file_size / MIN_CHUNK_SIZE + 1) {
+    thread_count = file_size / MIN_CHUNK_SIZE + 1;
+  }
+  chunk_count_task tasks[MAX_THREADS];
+  pthread_t threads[MAX_THREADS];
+  size_t started_threads = 0;
+  memset(tasks, 0, sizeof(tasks));
+  char *data = mmap(NULL, file_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  if (data == MAP_FAILED) {
+    perror("mmap");
+    return -1;
   }
+  posix_madvise(data, file_size, POSIX_MADV_SEQUENTIAL);
+  size_t chunk_start = 0;
+  for (size_t i = 0; i < thread_count; i++) {
+    size_t chunk_end = i == thread_count - 1
+                           ? file_size
+                           : tokenizer_next_delimiter(
+                                 data, file_size,
+                                 file_size / thread_count * (i + 1));
+    if (chunk_end < chunk_start) {
+      chunk_end = chunk_start;
+    }
+    tasks[i].data = data + chunk_start;
+    tasks[i].size = chunk_end - chunk_start;
+    // Все таблицы сливаются в первую, только ей нужна итоговая емкость
+    tasks[i].table =
+        create_words_table(word_hash, i == 0 ? expected_words : 0);
+    if (tasks[i].table == NULL) {
+      fprintf(stderr, "Error creating hash table\n");
+      ret_val = -2;
+      goto resources_release;
+    }
+    chunk_start = chunk_end;
+  }
+  for (; started_threads < thread_count; started_threads++) {
+    if (pthread_create(&threads[started_threads], NULL, count_chunk,
+                       &tasks[started_threads]) != 0) {
+      fprintf(stderr, "Cannot start counting thread\n");
+      ret_val = -3;
+      break;
+    }
+  }
+  size_t words = 0;
+  for (size_t i = 0; i < started_threads; i++) {
+    pthread_join(threads[i], NULL);
+    words += tasks[i].words;
+    if (tasks[i].result != 0) {
+      ret_val = -4;
+    }
+  }
+  if (ret_val != 0) {
+    goto resources_release;
+  }
+  for (size_t i = 1; i < thread_count; i++) {
+    if (merge_word_counts(tasks[0].table, tasks[i].table) != 0) {
+      ret_val = -5;
+      goto resources_release;
+    }
+  }
+  *words_table = tasks[0].table;
+  tasks[0].table = NULL;
   printf("\n");
+  printf("Bytes read: %zu\n", file_size);
+  printf("Words recognized: %zu\n", words);
+resources_release:
+  for (size_t i = 0; i < thread_count; i++) {
+    hash_table_free(tasks[i].table);
+  }
+  munmap(data, file_size);
+  return ret_val;
+}
+
+int add_file(file_queue *queue, const char *path) {
+  if (queue->count == queue->capacity) {
+    size_t capacity =
+        queue->capacity > 0 ? queue->capacity * 2 : INITIAL_FILE_CAPACITY;
+    file_task *files = realloc(queue->files, capacity * sizeof(file_task));
+    if (files == NULL) {
+      return -1;
+    }
+    queue->files = files;
+    queue->capacity = capacity;
+  }
+  char *path_copy = strdup(path);
+  if (path_copy == NULL) {
+    return -1;
+  }
+  file_task *file = &queue->files[queue->count++];
+  memset(file, 0, sizeof(file_task));
+  file->path = path_copy;
+  return 0;
+}
+
+/*
+ * Каталоги обходятся рекурсивно. Символьные ссылки внутри каталогов ведут
+ * только к файлам: ссылки на каталоги пропускаются, чтобы не зациклиться.
+ * Недоступные пути выводятся и пропускаются, ошибка возвращается только при
+ * нехватке памяти.
+ */
+int collect_files(file_queue *queue, const char *path, bool top_level) {
+  struct stat path_stat;
+  if ((top_level ? stat(path, &path_stat) : lstat(path, &path_stat)) != 0) {
+    fprintf(stderr, "Cannot access %s: ", path);
+    perror(NULL);
+    queue->skipped_paths++;
+    return 0;
+  }
+  if (S_ISLNK(path_stat.st_mode)) {
+    if (stat(path, &path_stat) != 0 || !S_ISREG(path_stat.st_mode)) {
+      return 0;
+    }
+  }
+  if (S_ISREG(path_stat.st_mode)) {
+    return add_file(queue, path);
+  }
+  if (!S_ISDIR(path_stat.st_mode)) {
+    if (top_level) {
+      fprintf(stderr, "%s is not a regular file or directory\n", path);
+      queue->skipped_paths++;
+    }
+    return 0;
+  }
+  DIR *dir = opendir(path);
+  if (dir == NULL) {
+    fprintf(stderr, "Cannot open directory %s: ", path);
+    perror(NULL);
+    queue->skipped_paths++;
+    return 0;
+  }
+  int ret_val = 0;
+  size_t path_length = strlen(path);
+  bool needs_separator = path_length > 0 && path[path_length - 1] != '/';
+  struct dirent *entry;
+  while (ret_val == 0 && (entry = readdir(dir)) != NULL) {
+    if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) {
+      continue;
+    }
+    size_t child_size = path_length + strlen(entry->d_name) + 2;
+    char *child = malloc(child_size);
+    if (child == NULL) {
+      ret_val = -1;
+      break;
+    }
+    snprintf(child, child_size, "%s%s%s", path, needs_separator ? "/" : "",
+             entry->d_name);
+    ret_val = collect_files(queue, child, false);
+    free(child);
+  }
+  closedir(dir);
+  return ret_val;
+}
+
+int count_file(file_task *file, hash_table *table) {
+  int fd = open(file->path, O_RDONLY);
+  if (fd < 0) {
+    file->error = errno;
+    return -1;
+  }
+  int ret_val = 0;
+  struct stat file_stat;
+  if (fstat(fd, &file_stat) != 0) {
+    file->error = errno;
+    ret_val = -2;
+    goto resources_release;
+  }
+  file->bytes = file_stat.st_size;
+  if (file->bytes == 0) {
+    goto resources_release;
+  }
+  char *data = mmap(NULL, file->bytes, PROT_READ, MAP_PRIVATE, fd, 0);
+  if (data == MAP_FAILED) {
+    file->error = errno;
+    ret_val = -3;
+    goto resources_release;
+  }
+  posix_madvise(data, file->bytes, POSIX_MADV_SEQUENTIAL);
+  chunk_count_task task = {.data = data, .size = file->bytes, .table = table};
+  count_chunk(&task);
+  file->words = task.words;
+  ret_val = task.result;
+  munmap(data, file->bytes);
+resources_release:
+  close(fd);
+  return ret_val;
+}
+
+void *count_files(void *arg) {
+  file_worker *worker = arg;
+  file_queue *queue = worker->queue;
+  while (true) {
+    pthread_mutex_lock(&queue->lock);
+    size_t index = queue->next_file;
+    if (index < queue->count) {
+      queue->next_file++;
+    }
+    pthread_mutex_unlock(&queue->lock);
+    if (index == queue->count) {
+      return NULL;
+    }
+    file_task *file = &queue->files[index];
+    file->result = count_file(file, worker->table);
+  }
+}
+
+/*
+ * Пути (файлы и каталоги) собираются в очередь, потоки берут из нее файлы
+ * по одному и считают слова в собственные таблицы, затем таблицы сливаются в
+ * первую, она возвращается в words_table. Файлы, которые не удалось прочитать,
+ * выводятся и пропускаются: тогда подсчет по остальным файлам завершается, а
+ * возвращается 1.
+ */
+int count_words_in_files(char **paths, size_t path_count, size_t thread_count,
+                         hash_table_hash_fn word_hash, size_t expected_words,
+                         bool per_file, hash_table **words_table) {
+  int ret_val = 0;
+  file_queue queue;
+  memset(&queue, 0, sizeof(queue));
+  pthread_mutex_init(&queue.lock, NULL);
+  file_worker workers[MAX_THREADS];
+  pthread_t threads[MAX_THREADS];
+  memset(workers, 0, sizeof(workers));
+  size_t started_threads = 0;
+  for (size_t i = 0; i < path_count; i++) {
+    if (collect_files(&queue, paths[i], true) != 0) {
+      ret_val = -1;
+      goto resources_release;
+    }
+  }
+  if (thread_count > queue.count) {
+    thread_count = queue.count > 0 ? queue.count : 1;
+  }
+  for (size_t i = 0; i < thread_count; i++) {
+    workers[i].queue = &queue;
+    workers[i].table =
+        create_words_table(word_hash, i == 0 ? expected_words : 0);
+    if (workers[i].table == NULL) {
+      fprintf(stderr, "Error creating hash table\n");
+      ret_val = -2;
+      goto resources_release;
+    }
+  }
+  if (thread_count == 1) {
+    count_files(&workers[0]);
+  }
+  for (; thread_count > 1 && started_threads < thread_count;
+       started_threads++) {
+    if (pthread_create(&threads[started_threads], NULL, count_files,
+                       &workers[started_threads]) != 0) {
+      fprintf(stderr, "Cannot start counting thread\n");
+      ret_val = -3;
+      break;
+    }
+  }
+  for (size_t i = 0; i < started_threads; i++) {
+    pthread_join(threads[i], NULL);
+  }
+  if (ret_val != 0) {
+    goto resources_release;
+  }
+  size_t bytes = 0;
+  size_t words = 0;
+  size_t files_read = 0;
+  size_t failed_files = 0;
+  for (size_t i = 0; i < queue.count; i++) {
+    file_task *file = &queue.files[i];
+    if (file->result != 0) {
+      fprintf(stderr, "Error counting words in file %s: %s\n", file->path,
+              file->error != 0 ? strerror(file->error) : "out of memory");
+      failed_files++;
+      continue;
+    }
+    files_read++;
+    bytes += file->bytes;
+    words += file->words;
+  }
+  for (size_t i = 1; ret_val == 0 && i < thread_count; i++) {
+    if (merge_word_counts(workers[0].table, workers[i].table) != 0) {
+      ret_val = -5;
+    }
+  }
+  if (ret_val != 0) {
+    goto resources_release;
+  }
+  *words_table = workers[0].table;
+  workers[0].table = NULL;
+  printf("\n");
+  if (per_file) {
+    for (size_t i = 0; i < queue.count; i++) {
+      if (queue.files[i].result == 0) {
+        printf("%s: %zu bytes, %zu words\n", queue.files[i].path,
+               queue.files[i].bytes, queue.files[i].words);
+      }
+    }
+  }
+  printf("Files read: %zu\n", files_read);
+  if (failed_files > 0 || queue.skipped_paths > 0) {
+    printf("Paths skipped: %zu\n", failed_files + queue.skipped_paths);
+    ret_val = 1;
+  }
   printf("Bytes read: %zu\n", bytes);
   printf("Words recognized: %zu\n", words);
 resources_release:
-  free(current_word_buffer);
+  for (size_t i = 0; i < thread_count; i++) {
+    hash_table_free(workers[i].table);
+  }
+  for (size_t i = 0; i < queue.count; i++) {
+    free(queue.files[i].path);
+  }
+  free(queue.files);
+  pthread_mutex_destroy(&queue.lock);
   return ret_val;
 }
 
 int main(int argc, char **argv) {
   setlocale(LC_ALL, "");
   int ret_val = 0;
-  char *infile_name = argc < 2 ? NULL : argv[1];
-  bool in_file_is_stdin = argc < 2 || strcmp(argv[1], "-") == 0;
+  size_t thread_count = 1;
+  output_mode mode = OUTPUT_UNORDERED;
+  size_t top_count = 0;
+  size_t expected_words = 0;
+  bool per_file = false;
+  const char *save_name = NULL;
+  const char *lookup_name = NULL;
+  const char *hash_name = DEFAULT_HASH_FUNCTION;
+  hash_table_hash_fn word_hash =
+      hash_functions_get_by_name(DEFAULT_HASH_FUNCTION);
+  size_t ngram_size = 1;
+  hash_table *words_table = NULL;
   FILE *infile = NULL;
-  if (argc > 1 && strcmp(argv[1], "-h") == 0) {
-    print_usage(argv[0]);
+  static const struct option long_options[] = {
+      {"help", no_argument, NULL, 'h'},
+      {"threads", required_argument, NULL, 'j'},
+      {"hash", required_argument, NULL, 'H'},
+      {"top", required_argument, NULL, 't'},
+      {"sort", no_argument, NULL, 's'},
+      {"approx", required_argument, NULL, 'a'},
+      {"save", required_argument, NULL, 'S'},
+      {"lookup", required_argument, NULL, 'l'},
+      {"words", required_argument, NULL, 'n'},
+      {"per-file", no_argument, NULL, 'p'},
+      {"ngram", required_argument, NULL, 'g'},
+      {NULL, 0, NULL, 0}};
+  int option;
+  while ((option = getopt_long(argc, argv, "hj:H:t:sa:S:l:n:pg:", long_options,
+                               NULL)) != -1) {
+    switch (option) {
+    case 'h':
+      print_usage(argv[0]);
+      goto release_resources;
+    case 'j':
+      thread_count = strtoul(optarg, NULL, 10);
+      if (thread_count == 0) {
+        long cpu_count = sysconf(_SC_NPROCESSORS_ONLN);
+        thread_count = cpu_count > 0 ? (size_t)cpu_count : 1;
+      }
+      if (thread_count > MAX_THREADS) {
+        thread_count = MAX_THREADS;
+      }
+      break;
+    case 'H':
+      word_hash = hash_functions_get_by_name(optarg);
+      hash_name = optarg;
+      if (word_hash == NULL) {
+        fprintf(stderr, "Unknown hash function %s\n", optarg);
+        print_usage(argv[0]);
+        ret_val = 1;
+        goto release_resources;
+      }
+      break;
+    case 't':
+      mode = OUTPUT_TOP;
+      top_count = strtoul(optarg, NULL, 10);
+      break;
+    case 's':
+      mode = OUTPUT_SORTED;
+      break;
+    case 'a':
+      mode = OUTPUT_APPROXIMATE;
+      top_count = strtoul(optarg, NULL, 10);
+      if (top_count == 0) {
+        fprintf(stderr, "Number of words for --approx must be positive\n");
+        ret_val = 1;
+        goto release_resources;
+      }
+      break;
+    case 'S':
+      save_name = optarg;
+      break;
+    case 'p':
+      per_file = true;
+      break;
+    case 'g':
+      ngram_size = strtoul(optarg, NULL, 10);
+      if (ngram_size < MIN_NGRAM_SIZE || ngram_size > MAX_NGRAM_SIZE) {
+        fprintf(stderr, "N-gram size must be between %d and %d\n",
+                MIN_NGRAM_SIZE, MAX_NGRAM_SIZE);
+        ret_val = 1;
+        goto release_resources;
+      }
+      break;
+    case 'n':
+      expected_words = strtoul(optarg, NULL, 10);
+      break;
+    case 'l':
+      mode = OUTPUT_LOOKUP;
+      lookup_name = optarg;
+      break;
+    default:
+      print_usage(argv[0]);
+      ret_val = 1;
+      goto release_resources;
+    }
+  }
+  hash_table_hash_id snapshot_hash_id = {hash_name, hash_functions_get_seed()};
+  char *infile_name = optind < argc ? argv[optind] : NULL;
+  bool in_file_is_stdin = infile_name == NULL || strcmp(infile_name, "-") == 0;
+  size_t path_count = argc - optind;
+  struct stat path_stat;
+  if (ngram_size > 1 && (mode == OUTPUT_LOOKUP || mode == OUTPUT_APPROXIMATE)) {
+    fprintf(stderr, "--ngram cannot be combined with --lookup or --approx\n");
+    ret_val = 1;
     goto release_resources;
   }
+  if (save_name != NULL &&
+      (mode == OUTPUT_LOOKUP || mode == OUTPUT_APPROXIMATE)) {
+    fprintf(stderr, "--save cannot be combined with --lookup or --approx\n");
+    ret_val = 1;
+    goto release_resources;
+  }
+  // Кроме подсчета в файле потоки используются только сортировкой
+  bool threads_count_words = !in_file_is_stdin && ngram_size == 1 &&
+                             mode != OUTPUT_LOOKUP &&
+                             mode != OUTPUT_APPROXIMATE;
+  if (thread_count > 1 && !threads_count_words && mode != OUTPUT_SORTED) {
+    fprintf(stderr, "-j cannot be combined with stdin, --lookup, --approx or "
+                    "--ngram unless --sort is given\n");
+    ret_val = 1;
+    goto release_resources;
+  }
+  if (path_count > 1 || (path_count == 1 && !in_file_is_stdin &&
+                         stat(infile_name, &path_stat) == 0 &&
+                         S_ISDIR(path_stat.st_mode))) {
+    if (mode == OUTPUT_LOOKUP || mode == OUTPUT_APPROXIMATE ||
+        ngram_size > 1) {
+      fprintf(stderr, "--lookup, --approx and --ngram take a single in_file\n");
+      ret_val = 1;
+      goto release_resources;
+    }
+    int count_res =
+        count_words_in_files(argv + optind, path_count, thread_count,
+                             word_hash, expected_words, per_file, &words_table);
+    if (count_res < 0) {
+      ret_val = 2;
+      goto release_resources;
+    }
+    // Пропущенные пути уже выведены, слова остальных файлов выводятся
+    if (count_res > 0) {
+      ret_val = 2;
+    }
+    goto print_stats;
+  }
 
   if (in_file_is_stdin) {
     infile = stdin;
@@ -189,25 +1126,79 @@ int main(int argc, char **argv) {
     ret_val = 1;
     goto release_resources;
   }
-  words_hash_table =
-      hash_table_init(word_hash, word_equals, INITIAL_TABLE_SIZE);
-  if (words_hash_table == NULL) {
+  if (mode == OUTPUT_LOOKUP) {
+    if (lookup_words(infile, lookup_name, word_hash, snapshot_hash_id) != 0) {
+      fprintf(stderr, "Error looking up words\n");
+      ret_val = 2;
+    }
+    goto release_resources;
+  }
+  if (mode == OUTPUT_APPROXIMATE) {
+    if (count_words_approximate(infile, top_count, word_hash) != 0) {
+      fprintf(stderr, "Error counting words in file %s\n",
+              infile_name == NULL ? "STDIN" : infile_name);
+      ret_val = 2;
+    }
+    goto release_resources;
+  }
+  if (ngram_size > 1) {
+    if (count_ngrams(infile, ngram_size, word_hash, &words_table) != 0) {
+      fprintf(stderr, "Error counting n-grams in file %s\n",
+              infile_name == NULL ? "STDIN" : infile_name);
+      ret_val = 2;
+      goto release_resources;
+    }
+    goto print_stats;
+  }
+  struct stat infile_stat;
+  bool infile_is_regular = !in_file_is_stdin &&
+                           fstat(fileno(infile), &infile_stat) == 0 &&
+                           S_ISREG(infile_stat.st_mode);
+  if (thread_count > 1 && !infile_is_regular && mode != OUTPUT_SORTED) {
+    fprintf(stderr, "-j needs a regular in_file, %s cannot be mapped\n",
+            infile_name);
+    ret_val = 1;
+    goto release_resources;
+  }
+  if (thread_count > 1 && infile_is_regular) {
+    if (count_words_parallel(fileno(infile), infile_stat.st_size,
+                             thread_count, word_hash, expected_words,
+                             &words_table) != 0) {
+      fprintf(stderr, "Error counting words in file %s\n", infile_name);
+      ret_val = 2;
+      goto release_resources;
+    }
+    goto print_stats;
+  }
+  words_table = create_words_table(word_hash, expected_words);
+  if (words_table == NULL) {
     fprintf(stderr, "Error creating hash table\n");
     ret_val = 3;
     goto release_resources;
   }
-  if (tokenize_by_words(infile, process_word) != 0) {
+  if (tokenize_by_words(infile, process_word, words_table, NULL) != 0) {
     fprintf(stderr, "Error founding word sizes in file");
     ret_val = 2;
     goto release_resources;
   };
-  print_word_stats();
+print_stats:
+  if (save_name != NULL &&
+      hash_table_save(words_table, save_name, word_size, sizeof(size_t),
+                      snapshot_hash_id) != 0) {
+    fprintf(stderr, "Error saving snapshot %s\n", save_name);
+    ret_val = 5;
+    goto release_resources;
+  }
+  if (print_word_stats(words_table, mode, top_count, thread_count) != 0) {
+    fprintf(stderr, "Error printing word stats\n");
+    ret_val = 4;
+  }
 release_resources:
   if (infile != NULL && !in_file_is_stdin && fclose(infile) < 0) {
     fprintf(stderr, "Error closing in file %s", infile_name);
   }
-  if (words_hash_table != NULL) {
-    hash_table_free(words_hash_table);
+  if (words_table != NULL) {
+    hash_table_free(words_table);
   }
   return ret_val;
 }
@@ -0,0 +1,271 @@
+#include "word_stats.h"
+#include <malloc.h>
+#include <pthread.h>
+#include <string.h>
+
+#define RADIX_BITS 8
+#define RADIX_BUCKETS (1 << RADIX_BITS)
+#define MAX_SORT_THREADS 256
+#define ENTRY_BATCH_SIZE 64
+
+typedef struct {
+  word_stat *source;
+  word_stat *destination;
+  size_t begin;
+  size_t middle;
+  size_t end;
+} sort_task;
+
+word_stat *word_stats_collect(hash_table *table, size_t *count) {
+  size_t size = hash_table_get_size(table);
+  word_stat *stats = malloc(sizeof(word_stat) * (size > 0 ? size : 1));
+  if (stats == NULL) {
+    return NULL;
+  }
+  size_t collected = 0;
+  hash_table_entry entries[ENTRY_BATCH_SIZE];
+  hash_table_iterator iterator;
+  hash_table_iterator_init(table, &iterator);
+  size_t batch_size;
+  while ((batch_size = hash_table_iterator_next_batch(
+              table, &iterator, entries, ENTRY_BATCH_SIZE)) > 0) {
+    for (size_t i = 0; i < batch_size; i++) {
+      stats[collected + i].word = entries[i].key;
+      stats[collected + i].count = *(const size_t *)entries[i].value;
+    }
+    collected += batch_size;
+  }
+  *count = collected;
+  return stats;
+}
+
+static void heap_swap(word_stat *heap, size_t a, size_t b) {
+  word_stat temp = heap[a];
+  heap[a] = heap[b];
+  heap[b] = temp;
+}
+
+static void heap_sift_down(word_stat *heap, size_t size, size_t index) {
+  while (true) {
+    size_t smallest = index;
+    size_t left = index * 2 + 1;
+    size_t right = left + 1;
+    if (left < size && heap[left].count < heap[smallest].count) {
+      smallest = left;
+    }
+    if (right < size && heap[right].count < heap[smallest].count) {
+      smallest = right;
+    }
+    if (smallest == index) {
+      return;
+    }
+    heap_swap(heap, index, smallest);
+    index = smallest;
+  }
+}
+
+static void heap_sift_up(word_stat *heap, size_t index) {
+  while (index > 0) {
+    size_t parent = (index - 1) / 2;
+    if (heap[parent].count <= heap[index].count) {
+      return;
+    }
+    heap_swap(heap, index, parent);
+    index = parent;
+  }
+}
+
+word_stat *word_stats_top(hash_table *table, size_t top_count, size_t *count) {
+  word_stat *heap = malloc(sizeof(word_stat) * (top_count > 0 ? top_count : 1));
+  if (heap == NULL) {
+    return NULL;
+  }
+  size_t heap_size = 0;
+  hash_table_entry entries[ENTRY_BATCH_SIZE];
+  hash_table_iterator iterator;
+  hash_table_iterator_init(table, &iterator);
+  size_t batch_size;
+  while (top_count > 0 && (batch_size = hash_table_iterator_next_batch(
+                               table, &iterator, entries,
+                               ENTRY_BATCH_SIZE)) > 0) {
+    for (size_t i = 0; i < batch_size; i++) {
+      size_t entry_count = *(const size_t *)entries[i].value;
+      if (heap_size < top_count) {
+        heap[heap_size].word = entries[i].key;
+        heap[heap_size].count = entry_count;
+        heap_sift_up(heap, heap_size);
+        heap_size++;
+      } else if (entry_count > heap[0].count) {
+        heap[0].word = entries[i].key;
+        heap[0].count = entry_count;
+        heap_sift_down(heap, heap_size, 0);
+      }
+    }
+  }
+  *count = heap_size;
+  if (!word_stats_sort(heap, heap_size, 1)) {
+    free(heap);
+    return NULL;
+  }
+  return heap;
+}
+
+// LSD radix sort by the inverted count, so larger counts come first.
+static void radix_sort(word_stat *stats, word_stat *buffer, size_t count) {
+  word_stat *source = stats;
+  word_stat *destination = buffer;
+  for (unsigned int shift = 0; shift < sizeof(size_t) * 8;
+       shift += RADIX_BITS) {
+    size_t histogram[RADIX_BUCKETS] = {0};
+    for (size_t i = 0; i < count; i++) {
+      histogram[(~source[i].count >> shift) & (RADIX_BUCKETS - 1)]++;
+    }
+    bool single_bucket = false;
+    size_t offset = 0;
+    for (size_t bucket = 0; bucket < RADIX_BUCKETS; bucket++) {
+      if (histogram[bucket] == count) {
+        single_bucket = true;
+        break;
+      }
+      size_t bucket_size = histogram[bucket];
+      histogram[bucket] = offset;
+      offset += bucket_size;
+    }
+    if (single_bucket) {
+      continue;
+    }
+    for (size_t i = 0; i < count; i++) {
+      size_t bucket = (~source[i].count >> shift) & (RADIX_BUCKETS - 1);
+      destination[histogram[bucket]++] = source[i];
+    }
+    word_stat *temp = source;
+    source = destination;
+    destination = temp;
+  }
+  if (source != stats) {
+    memcpy(stats, source, sizeof(word_stat) * count);
+  }
+}
+
+static void *radix_sort_part(void *arg) {
+  sort_task *task = arg;
+  radix_sort(task->source + task->begin, task->destination + task->begin,
+             task->end - task->begin);
+  return NULL;
+}
+
+static void *merge_parts(void *arg) {
+  sort_task *task = arg;
+  size_t left = task->begin;
+  size_t right = task->middle;
+  size_t out = task->begin;
+  while (left < task->middle && right < task->end) {
+    if (task->source[left].count >= task->source[right].count) {
+      task->destination[out++] = task->source[left++];
+    } else {
+      task->destination[out++] = task->source[right++];
+    }
+  }
+  memcpy(task->destination + out, task->source + left,
+         sizeof(word_stat) * (task->middle - left));
+  out += task->middle - left;
+  memcpy(task->destination + out, task->source + right,
+         sizeof(word_stat) * (task->end - right));
+  return NULL;
+}
+
+static bool run_tasks(void *(*worker)(void *), sort_task *tasks,
+                      size_t task_count) {
+  pthread_t threads[MAX_SORT_THREADS];
+  size_t started = 0;
+  bool ret_val = true;
+  // The last task runs in the calling thread
+  for (; started + 1 < task_count; started++) {
+    if (pthread_create(&threads[started], NULL, worker, &tasks[started]) !=
+        0) {
+      ret_val = false;
+      break;
+    }
+  }
+  if (ret_val) {
+    worker(&tasks[task_count - 1]);
+  }
+  for (size_t i = 0; i < started; i++) {
+    pthread_join(threads[i], NULL);
+  }
+  return ret_val;
+}
+
+bool word_stats_sort(word_stat *stats, size_t count, size_t thread_count) {
+  if (count < 2) {
+    return true;
+  }
+  if (thread_count > MAX_SORT_THREADS) {
+    thread_count = MAX_SORT_THREADS;
+  }
+  if (thread_count > count) {
+    thread_count = count;
+  }
+  if (thread_count == 0) {
+    thread_count = 1;
+  }
+  word_stat *buffer = malloc(sizeof(word_stat) * count);
+  if (buffer == NULL) {
+    return false;
+  }
+  sort_task tasks[MAX_SORT_THREADS];
+  size_t bounds[MAX_SORT_THREADS + 1];
+  for (size_t i = 0; i <= thread_count; i++) {
+    bounds[i] = count / thread_count * i;
+  }
+  bounds[thread_count] = count;
+  for (size_t i = 0; i < thread_count; i++) {
+    tasks[i] = (sort_task){.source = stats,
+                           .destination = buffer,
+                           .begin = bounds[i],
+                           .end = bounds[i + 1]};
+  }
+  bool ret_val = run_tasks(radix_sort_part, tasks, thread_count);
+  word_stat *source = stats;
+  word_stat *destination = buffer;
+  size_t part_count = thread_count;
+  while (ret_val && part_count > 1) {
+    size_t task_count = 0;
+    for (size_t i = 0; i < part_count; i += 2) {
+      // An odd last part is "merged" with an empty one, i.e. copied
+      size_t end = i + 2 <= part_count ? bounds[i + 2] : bounds[i + 1];
+      tasks[task_count++] = (sort_task){.source = source,
+                                        .destination = destination,
+                                        .begin = bounds[i],
+                                        .middle = bounds[i + 1],
+                                        .end = end};
+    }
+    ret_val = run_tasks(merge_parts, tasks, task_count);
+    for (size_t i = 0; i < task_count; i++) {
+      bounds[i] = tasks[i].begin;
+    }
+    bounds[task_count] = count;
+    part_count = task_count;
+    word_stat *temp = source;
+    source = destination;
+    destination = temp;
+  }
+  if (ret_val && source != stats) {
+    memcpy(stats, source, sizeof(word_stat) * count);
+  }
+  free(buffer);
+  return ret_val;
+}
+
+bool word_stats_write(buffered_writer *writer, const word_stat *stats,
+                      size_t count) {
+  for (size_t i = 0; i < count; i++) {
+    buffered_writer_write_string(writer, stats[i].word);
+    buffered_writer_write(writer, ": ", 2);
+    buffered_writer_write_size(writer, stats[i].count);
+    if (!buffered_writer_write(writer, "\n", 1)) {
+      return false;
+    }
+  }
+  return true;
+}
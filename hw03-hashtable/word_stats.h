@@ -0,0 +1,35 @@
+#ifndef WORD_STATS_H
+#define WORD_STATS_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "buffered_writer.h"
+#include "hash_table.h"
+
+/*
+ * Extraction of (word, count) pairs from a table of size_t counters keyed by
+ * NUL-terminated words, ordered by count in descending order.
+ */
+
+typedef struct {
+  const char *word;
+  size_t count;
+} word_stat;
+
+// Collects all entries of the table, in table order.
+word_stat *word_stats_collect(hash_table *table, size_t *count);
+/*
+ * Selects the top_count most frequent words with a bounded min-heap while
+ * iterating over the table. The result is sorted by count.
+ */
+word_stat *word_stats_top(hash_table *table, size_t top_count, size_t *count);
+/*
+ * Stable radix sort by count in descending order. The array is split between
+ * thread_count threads and the sorted parts are merged pairwise in parallel.
+ */
+bool word_stats_sort(word_stat *stats, size_t count, size_t thread_count);
+bool word_stats_write(buffered_writer *writer, const word_stat *stats,
+                      size_t count);
+
+#endif